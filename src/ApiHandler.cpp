@@ -1,7 +1,15 @@
 #include "ApiHandler.hpp"
+#include "Metrics.hpp"
+#include "SessionPool.hpp"
+#include "Quota.hpp"
+#include "Retry.hpp"
+#include "SingleFlight.hpp"
+#include "CacheKey.hpp"
 
 #include <string_view>
 #include <algorithm>
+#include <mutex>
+#include <condition_variable>
 
 namespace WayHome {
 
@@ -13,44 +21,204 @@ void ApiHandler::SetParameters(ApiRouteParameters parameters) {
     parameters_ = std::move(parameters);
 }
 
-std::expected<json, Error> ApiHandler::MakeRoutesRequest() const {
+std::expected<json, Error> ApiHandler::MakeRoutesRequest(std::stop_token stop_token,
+                                                      std::chrono::milliseconds timeout) const {
+    return MakeRoutesPageRequest(0, std::move(stop_token), timeout);
+}
+
+std::expected<json, Error> ApiHandler::MakeRoutesPageRequest(size_t offset,
+                                                          std::stop_token stop_token,
+                                                          std::chrono::milliseconds timeout) const {
     if (!ValidateParameters()) {
-        return std::unexpected{Error{"Invalid parameters", ErrorType::kParametersError}};
+        return std::unexpected{GetError()};
     }
 
-    cpr::Response r = cpr::Get(
-        cpr::Url{kApiUrl},
-        cpr::Parameters{
-            {"from", parameters_.from},
-            {"to", parameters_.to},
-            {"transfers", (parameters_.max_transfers == 0 ? "false" : "true")},
-            {"transport_types", parameters_.transport_type},
-            {"date", parameters_.date},
-            {"format", "json"}
-        },
-        cpr::Header{{"Authorization", apikey_}}
-    );
-
-    return ProcessRequest(r);
-}
-
-std::expected<json, Error> ApiHandler::MakeSuggestsRequest(const std::string& input) const {
-    cpr::Response r = cpr::Get(
-        cpr::Url{kSuggestsUrl},
-        cpr::Parameters{
-            {"part", input},
-            {"format", "json"}
+    // Identical searches made at the same time share one request
+    return GetSingleFlight().Do("search:" + MakeRoutesPageCacheKey(parameters_, offset), [&] {
+        ScopedTimer timer{Stage::kRoutesRequest};
+
+        return Send(
+            RequestClass::kSearch,
+            cpr::Url{kApiUrl},
+            cpr::Parameters{
+                {"from", parameters_.from},
+                {"to", parameters_.to},
+                {"transfers", (parameters_.max_transfers == 0 ? "false" : "true")},
+                {"transport_types", parameters_.transport_type},
+                {"date", parameters_.date},
+                {"offset", std::to_string(offset)},
+                {"limit", std::to_string(kApiPageLimit)},
+                {"format", "json"}
+            },
+            cpr::Header{{"Authorization", apikey_}},
+            stop_token,
+            timeout
+        );
+    }, stop_token);
+}
+
+std::expected<json, Error> ApiHandler::MakeSuggestsRequest(const std::string& input,
+                                                        std::stop_token stop_token,
+                                                        std::chrono::milliseconds timeout) const {
+    return GetSingleFlight().Do("suggests:" + input, [&] {
+        ScopedTimer timer{Stage::kSuggestsRequest};
+
+        return Send(
+            RequestClass::kSuggests,
+            cpr::Url{kSuggestsUrl},
+            cpr::Parameters{
+                {"part", input},
+                {"format", "json"}
+            },
+            cpr::Header{},
+            stop_token,
+            timeout
+        );
+    }, stop_token);
+}
+
+std::future<std::expected<json, Error>> ApiHandler::MakeRoutesRequestAsync(std::stop_token stop_token,
+                                                                          std::chrono::milliseconds timeout) const {
+    return std::async(std::launch::async, [handler = *this, stop_token = std::move(stop_token), timeout] {
+        return handler.MakeRoutesRequest(stop_token, timeout);
+    });
+}
+
+std::future<std::expected<json, Error>> ApiHandler::MakeSuggestsRequestAsync(const std::string& input,
+                                                                            std::stop_token stop_token,
+                                                                            std::chrono::milliseconds timeout) const {
+    return std::async(std::launch::async, [handler = *this, input, stop_token = std::move(stop_token), timeout] {
+        return handler.MakeSuggestsRequest(input, stop_token, timeout);
+    });
+}
+
+std::expected<json, Error> ApiHandler::Send(RequestClass request_class,
+                                            cpr::Url url,
+                                            cpr::Parameters parameters,
+                                            cpr::Header header,
+                                            std::stop_token stop_token,
+                                            std::chrono::milliseconds timeout) const {
+    RetryPolicy policy = GetApiResilience().GetPolicy();
+    CircuitBreaker& breaker = GetApiResilience().GetBreaker(request_class);
+
+    for (uint32_t attempt = 1;; ++attempt) {
+        if (!breaker.TryAcquire()) {
+            GetMetrics().Increment(Counter::kApiCircuitRejected);
+            return std::unexpected{Error{"API is not asked for a while after repeated failures: " + url.str(),
+                                         ErrorType::kNetworkError}};
+        }
+
+        bool is_timed_out = false;
+        std::expected<cpr::Response, Error> response
+            = Attempt(request_class, url, parameters, header, stop_token, timeout, is_timed_out);
+
+        if (!response.has_value()) {
+            breaker.Release();
+            return std::unexpected{std::move(response.error())};
+        }
+
+        const cpr::Response& r = response.value();
+        std::expected<json, Error> result;
+
+        if (is_timed_out) {
+            GetMetrics().Increment(Counter::kApiRequests);
+            GetMetrics().Increment(Counter::kApiErrors);
+            result = std::unexpected{Error{"Request timed out: " + url.str(), ErrorType::kNetworkError}};
+        } else {
+            result = ProcessRequest(r);
+        }
+
+        // Rejected requests, 429 included, also mean that the API is up
+        if (IsUnavailable(r)) {
+            breaker.RecordFailure();
+        } else {
+            breaker.RecordSuccess();
+        }
+
+        if (!IsRetriable(r)) {
+            return result;
+        }
+
+        std::chrono::milliseconds delay = policy.GetBackoff(attempt);
+
+        if (auto it = r.header.find("Retry-After"); it != r.header.end()) {
+            delay = ParseRetryAfter(it->second).value_or(delay);
         }
-    );
 
-    return ProcessRequest(r);
+        // Waiting longer than max_delay is not worth it, the API is given up on instead
+        if (attempt >= policy.attempts || delay > policy.max_delay) {
+            return result;
+        }
+
+        // Every attempt is admitted by ApiQuota on its own: the API counts each request that reaches it
+        GetMetrics().Increment(Counter::kApiRetries);
+
+        std::mutex mutex;
+        std::condition_variable_any wakeup;
+        std::unique_lock lock{mutex};
+
+        wakeup.wait_for(lock, stop_token, delay, [] { return false; });
+
+        if (stop_token.stop_requested()) {
+            return std::unexpected{Error{"Request was cancelled: " + url.str(), ErrorType::kNetworkError}};
+        }
+    }
+}
+
+std::expected<cpr::Response, Error> ApiHandler::Attempt(RequestClass request_class,
+                                                        const cpr::Url& url,
+                                                        const cpr::Parameters& parameters,
+                                                        const cpr::Header& header,
+                                                        const std::stop_token& stop_token,
+                                                        std::chrono::milliseconds timeout,
+                                                        bool& is_timed_out) const {
+    if (stop_token.stop_requested()) {
+        return std::unexpected{Error{"Request was cancelled", ErrorType::kNetworkError}};
+    }
+
+    std::optional<Error> admission_error = GetApiQuota().Admit(request_class, stop_token, timeout);
+
+    if (admission_error.has_value()) {
+        return std::unexpected{admission_error.value()};
+    }
+
+    SessionPool::Lease session = GetSessionPool().Acquire();
+
+    // Everything is set on every request, pooled sessions keep the settings of the previous one
+    session->SetUrl(url);
+    session->SetParameters(parameters);
+    session->SetHeader(header);
+    session->SetTimeout(cpr::Timeout{timeout});
+    // Called by curl at least once a second while the request runs, returning false aborts it
+    session->SetProgressCallback(cpr::ProgressCallback{[stop_token](auto&&...) {
+        return !stop_token.stop_requested();
+    }});
+
+    auto start = std::chrono::steady_clock::now();
+    cpr::Response r = session->Get();
+    session.CountConnection();
+
+    // Failed requests have no status
+    if (r.status_code == 0 && stop_token.stop_requested()) {
+        return std::unexpected{Error{"Request was cancelled: " + url.str(), ErrorType::kNetworkError}};
+    }
+
+    is_timed_out = r.status_code == 0 && std::chrono::steady_clock::now() - start >= timeout;
+
+    return r;
 }
 
 std::expected<json, Error> ApiHandler::ProcessRequest(const cpr::Response& r) const {
-    ProcessRequestErrors(r);
+    GetMetrics().Increment(Counter::kApiRequests);
+    // Bodies are counted after decoding and as they came over the wire, the difference is what compression saved
+    GetMetrics().Increment(Counter::kApiBytesReceived, r.text.size());
+    GetMetrics().Increment(Counter::kApiBytesTransferred, static_cast<uint64_t>(std::max<int64_t>(r.downloaded_bytes, 0)));
 
-    if (HasError()) {
-        return std::unexpected{GetError()};
+    Error error = GetResponseError(r);
+
+    if (error.type != ErrorType::kOk) {
+        GetMetrics().Increment(Counter::kApiErrors);
+        return std::unexpected{std::move(error)};
     }
 
     try {
@@ -60,14 +228,29 @@ std::expected<json, Error> ApiHandler::ProcessRequest(const cpr::Response& r) co
     }
 }
 
-void ApiHandler::ProcessRequestErrors(const cpr::Response& r) const {
+Error ApiHandler::GetResponseError(const cpr::Response& r) {
     if (r.status_code >= 300 && r.status_code < 400 || r.status_code >= 500) {
-        error_ = {"API error: " + r.error.message, ErrorType::kApiError};
+        return {"API error: " + r.error.message, ErrorType::kApiError};
+    } else if (r.status_code == 401 || r.status_code == 403) {
+        return {"API key was rejected: " + r.url.str(), ErrorType::kApiError};
+    } else if (r.status_code == 429) {
+        return {"API request limit exceeded: " + r.url.str(), ErrorType::kApiError};
     } else if (r.status_code >= 400 && r.status_code < 500) {
-        error_ = {"Parameters error in request: " + r.url.str(), ErrorType::kParametersError};
+        return {"Parameters error in request: " + r.url.str(), ErrorType::kParametersError};
     } else if (r.status_code != 200) {
-        error_ = {"Network error", ErrorType::kNetworkError};
+        return {"Network error", ErrorType::kNetworkError};
     }
+
+    return {};
+}
+
+bool ApiHandler::IsUnavailable(const cpr::Response& r) {
+    return r.status_code == 0 || r.status_code >= 500;
+}
+
+bool ApiHandler::IsRetriable(const cpr::Response& r) {
+    // Without Retry-After a 429 usually means that the daily limit is used up, waiting won't help
+    return IsUnavailable(r) || (r.status_code == 429 && r.header.contains("Retry-After"));
 }
 
 bool ApiHandler::ValidateParameters() const {
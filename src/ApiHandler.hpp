@@ -10,12 +10,19 @@ using json = nlohmann::json;
 #include <expected>
 #include <optional>
 #include <utility>
+#include <future>
+#include <stop_token>
+#include <chrono>
 
 namespace WayHome {
 
 const std::string kApiUrl{"https://api.rasp.yandex.net/v3.0/search/"};
 const std::string kSuggestsUrl{"https://suggests.rasp.yandex.net/all_suggests"};
 
+const std::chrono::milliseconds kApiDefaultTimeout{30 * 1000};
+// Routes asked for in one search request, the most the API returns
+const size_t kApiPageLimit = 100;
+
 struct ApiRouteParameters {
     std::string from;
     std::string to;
@@ -48,6 +55,9 @@ struct Error {
     ErrorType type = ErrorType::kOk;
 };
 
+// Defined in Quota.hpp
+enum class RequestClass;
+
 class ApiHandler {
 public:
     ApiHandler(std::string apikey, ApiRouteParameters parameters)
@@ -59,8 +69,27 @@ public:
     void SetApikey(std::string apikey);
     void SetParameters(ApiRouteParameters parameters);
 
-    std::expected<json, Error> MakeRoutesRequest() const;
-    std::expected<json, Error> MakeSuggestsRequest(const std::string& input) const;
+    // Each attempt of a request gives up after `timeout`, the request gives up when a stop is requested for `stop_token`.
+    // Network errors, timeouts, 5xx and 429 responses with Retry-After are retried as the RetryPolicy
+    // of GetApiResilience() says. Each attempt takes a request from the daily quota.
+    // A request identical to one in flight waits for its result instead of being sent, see SingleFlight.
+    // The first page of routes, "pagination" in the response tells if there are more
+    std::expected<json, Error> MakeRoutesRequest(std::stop_token stop_token = {},
+                                                 std::chrono::milliseconds timeout = kApiDefaultTimeout) const;
+    // Up to kApiPageLimit routes starting from the `offset`-th one
+    std::expected<json, Error> MakeRoutesPageRequest(size_t offset,
+                                                     std::stop_token stop_token = {},
+                                                     std::chrono::milliseconds timeout = kApiDefaultTimeout) const;
+    std::expected<json, Error> MakeSuggestsRequest(const std::string& input,
+                                                   std::stop_token stop_token = {},
+                                                   std::chrono::milliseconds timeout = kApiDefaultTimeout) const;
+
+    // Same requests made by a thread of their own. The handler is copied,
+    // so it may be changed or destroyed while they run.
+    std::future<std::expected<json, Error>> MakeRoutesRequestAsync(
+        std::stop_token stop_token = {}, std::chrono::milliseconds timeout = kApiDefaultTimeout) const;
+    std::future<std::expected<json, Error>> MakeSuggestsRequestAsync(
+        const std::string& input, std::stop_token stop_token = {}, std::chrono::milliseconds timeout = kApiDefaultTimeout) const;
 
     bool ValidateParameters() const;
 
@@ -70,10 +99,32 @@ public:
 private:
     std::string apikey_;
     ApiRouteParameters parameters_;
+    // Set by ValidateParameters only. Requests report their errors in the result,
+    // so a handler may send several of them at the same time.
     mutable Error error_;
 
+    // Retries failed attempts unless the circuit breaker of the request class is open
+    std::expected<json, Error> Send(RequestClass request_class,
+                                    cpr::Url url,
+                                    cpr::Parameters parameters,
+                                    cpr::Header header,
+                                    std::stop_token stop_token,
+                                    std::chrono::milliseconds timeout) const;
+    // Admitted by ApiQuota first, waits for the rate limit at most `timeout`.
+    // Fails only if the request wasn't made or was cancelled.
+    std::expected<cpr::Response, Error> Attempt(RequestClass request_class,
+                                                const cpr::Url& url,
+                                                const cpr::Parameters& parameters,
+                                                const cpr::Header& header,
+                                                const std::stop_token& stop_token,
+                                                std::chrono::milliseconds timeout,
+                                                bool& is_timed_out) const;
     std::expected<json, Error> ProcessRequest(const cpr::Response& r) const;
-    void ProcessRequestErrors(const cpr::Response& r) const;
+    static Error GetResponseError(const cpr::Response& r);
+    // No answer or a server error, counted by the circuit breaker
+    static bool IsUnavailable(const cpr::Response& r);
+    // Failures that may go away if the request is repeated
+    static bool IsRetriable(const cpr::Response& r);
 };
     
 } // namespace WayHome
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+namespace WayHome {
+
+// Helpers for the binary cache formats. Integers are stored in the host byte order,
+// cache files are not meant to be moved between machines.
+
+template<typename T>
+    requires (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+void AppendBinary(std::string& to, T value) {
+    to.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+inline void AppendBinary(std::string& to, std::string_view value) {
+    AppendBinary(to, static_cast<uint32_t>(value.size()));
+    to.append(value);
+}
+
+template<typename T>
+    requires (std::is_arithmetic_v<T> || std::is_enum_v<T>)
+bool ReadBinary(std::string_view& from, T& value) {
+    if (from.size() < sizeof(T)) {
+        return false;
+    }
+
+    std::memcpy(&value, from.data(), sizeof(T));
+    from.remove_prefix(sizeof(T));
+
+    return true;
+}
+
+inline bool ReadBinary(std::string_view& from, std::string& value) {
+    uint32_t size;
+
+    if (!ReadBinary(from, size) || from.size() < size) {
+        return false;
+    }
+
+    value.assign(from.data(), size);
+    from.remove_prefix(size);
+
+    return true;
+}
+
+} // namespace WayHome
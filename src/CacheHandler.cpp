@@ -1,87 +1,230 @@
 #include "CacheHandler.hpp"
+#include "Metrics.hpp"
 
-#include <filesystem>
 #include <chrono>
-#include <fstream>
 
 namespace WayHome {
 
 bool CacheHandler::IsCacheExpired(const std::string& filename) const {
-    std::error_code ec;
-    auto file_time = std::filesystem::last_write_time(cache_dir_ + '/' + filename, ec);
+    std::optional<std::chrono::system_clock::time_point> expiration_time = GetExpirationTime(filename);
+    return !expiration_time.has_value() || std::chrono::system_clock::now() >= expiration_time.value();
+}
+
+std::optional<std::chrono::system_clock::time_point> CacheHandler::GetExpirationTime(const std::string& filename) const {
+    std::optional<CacheEntryInfo> info = GetInfo(filename);
+
+    if (!info.has_value()) {
+        return std::nullopt;
+    }
 
-    if (ec) {
-        return true;
+    if (info->expires_at == kCacheNeverExpires) {
+        return std::chrono::system_clock::time_point::max();
     }
 
-    auto now = std::chrono::system_clock::now();
-    auto system_file_time = now - (std::filesystem::file_time_type::clock::now() - file_time);
-    
-    return now - system_file_time >= std::chrono::seconds(ttl_seconds_);
+    return std::chrono::system_clock::time_point{std::chrono::seconds(info->expires_at)};
 }
 
-bool CacheHandler::UpdateCache(const json& obj, const std::string& filename) const {
-    std::error_code ec;
-    std::filesystem::create_directory(cache_dir_, ec);
+bool CacheHandler::UpdateCache(const json& obj, const std::string& filename, std::optional<uint32_t> ttl_seconds) const {
+    std::string data;
 
-    std::ofstream file(cache_dir_ + '/' + filename);
+    try {
+        data = obj.dump();
+    } catch (const json::exception& e) {
+        return false;
+    }
 
-    if (ec || !file.good()) {
+    return UpdateCacheBinary(data, filename, ttl_seconds);
+}
+
+bool CacheHandler::LoadCache(json& to, const std::string& filename) const {
+    std::optional<CacheView> view = View(filename);
+
+    if (!view.has_value()) {
         return false;
     }
 
     try {
-        file << obj;
+        to = json::parse(view->value.begin(), view->value.end());
     } catch (const json::exception& e) {
         return false;
     }
 
-    return file.good();
+    return true;
 }
 
-bool CacheHandler::LoadCache(json& to, const std::string& filename) const {
-    std::ifstream file(cache_dir_ + '/' + filename);
+bool CacheHandler::ModifyCache(const std::string& filename, const std::function<bool(json&)>& modify) const {
+    int64_t now = GetUnixTime();
+
+    size_t written = 0;
+
+    auto modify_data = [&modify, &written](std::optional<std::string_view> data) -> std::optional<std::string> {
+        json obj = json::object();
+
+        if (data.has_value()) {
+            obj = json::parse(data->begin(), data->end(), nullptr, false);
+
+            // Writing an empty object over it would lose everything the entry holds
+            if (obj.is_discarded()) {
+                return std::nullopt;
+            }
+        }
+
+        if (!modify(obj)) {
+            return std::nullopt;
+        }
 
-    if (!file.good()) {
+        try {
+            std::string dumped = obj.dump();
+            written = dumped.size();
+
+            return dumped;
+        } catch (const json::exception& e) {
+            return std::nullopt;
+        }
+    };
+
+    if (!store_->Modify(filename, modify_data, now, ttl_seconds_ == 0 ? kCacheNeverExpires : now + ttl_seconds_)) {
         return false;
     }
 
-    try {
-        to = json::parse(file);
-    } catch (const json::exception& e) {
+    GetMetrics().Increment(Counter::kCacheBytesWritten, written);
+    return true;
+}
+
+bool CacheHandler::RememberFailure(const Error& error, const std::string& filename, uint32_t ttl_seconds) const {
+    json failure_obj = {
+        {"message", error.message},
+        {"type", static_cast<int>(error.type)}
+    };
+
+    return UpdateCache(failure_obj, filename, ttl_seconds);
+}
+
+std::optional<Error> CacheHandler::LoadFailure(const std::string& filename) const {
+    // Most lookups have no failure to find, so these are not counted as misses
+    std::optional<CacheEntryInfo> info = GetInfo(filename);
+
+    if (!info.has_value() || (info->expires_at != kCacheNeverExpires && info->expires_at <= GetUnixTime())) {
+        return std::nullopt;
+    }
+
+    std::optional<CacheView> view = store_->View(filename);
+
+    if (!view.has_value()) {
+        return std::nullopt;
+    }
+
+    json failure_obj = json::parse(view->value.begin(), view->value.end(), nullptr, false);
+
+    if (!failure_obj.is_object()
+    || !failure_obj.contains("message") || !failure_obj["message"].is_string()
+    || !failure_obj.contains("type") || !failure_obj["type"].is_number_integer()) {
+        return std::nullopt;
+    }
+
+    GetMetrics().Increment(Counter::kCacheNegativeHits);
+    GetMetrics().Increment(Counter::kCacheBytesRead, view->value.size());
+
+    return Error{failure_obj["message"], static_cast<ErrorType>(failure_obj["type"].get<int>())};
+}
+
+bool CacheHandler::UpdateCacheBinary(std::string_view data,
+                                     const std::string& filename,
+                                     std::optional<uint32_t> ttl_seconds) const {
+    int64_t now = GetUnixTime();
+    uint32_t ttl = ttl_seconds.value_or(ttl_seconds_);
+
+    if (!store_->Put(filename, data, now, ttl == 0 ? kCacheNeverExpires : now + ttl)) {
+        return false;
+    }
+
+    GetMetrics().Increment(Counter::kCacheBytesWritten, data.size());
+    return true;
+}
+
+bool CacheHandler::LoadCacheBinary(std::string& to, const std::string& filename) const {
+    std::optional<CacheView> view = View(filename);
+
+    if (!view.has_value()) {
         return false;
     }
 
+    to.assign(view->value);
+    return true;
+}
+
+std::optional<CacheView> CacheHandler::ViewCache(const std::string& filename) const {
+    return View(filename);
+}
+
+bool CacheHandler::RewriteCacheBinary(std::string_view data, const std::string& filename) const {
+    std::optional<CacheEntryInfo> info = store_->GetInfo(filename);
+
+    if (!info.has_value()) {
+        return false;
+    }
+
+    if (!store_->Put(filename, data, info->written_at, info->expires_at)) {
+        return false;
+    }
+
+    GetMetrics().Increment(Counter::kCacheBytesWritten, data.size());
     return true;
 }
 
 bool CacheHandler::ClearAllCache() const {
-    std::error_code ec;
-    std::filesystem::remove_all(cache_dir_, ec);
-    return !ec;
+    return store_->Clear();
+}
+
+size_t CacheHandler::ImportLegacyFiles(const std::function<std::optional<std::string>(std::string_view)>& make_key) const {
+    return store_->ImportFiles(make_key, ttl_seconds_);
+}
+
+bool CacheHandler::ClearExpiredCache(std::chrono::microseconds budget) const {
+    // Only the due entries are popped from the index, their records are dropped by the compaction.
+    // Whatever doesn't fit into the budget is swept in the background.
+    store_->EraseExpired(GetUnixTime(), budget);
+    store_->MaintainAsync();
+
+    return true;
+}
+
+void CacheHandler::SetExpiryGrace(std::chrono::seconds grace) const {
+    store_->SetExpiryGrace(grace);
 }
 
-bool CacheHandler::ClearExpiredCache() const {
-    if (!std::filesystem::exists(cache_dir_)) {
-        return true;
+void CacheHandler::SetLimits(const CacheLimits& limits) const {
+    store_->SetLimits(limits);
+}
+
+CacheStats CacheHandler::GetStats() const {
+    return store_->GetStats();
+}
+
+std::optional<CacheEntryInfo> CacheHandler::GetInfo(const std::string& filename) const {
+    std::optional<CacheEntryInfo> info = store_->GetInfo(filename);
+
+    if (!info.has_value() || (info->expires_at != kCacheNeverExpires && info->expires_at <= GetUnixTime())) {
+        store_->Refresh();
+        info = store_->GetInfo(filename);
     }
 
-    std::filesystem::path dir{cache_dir_};
+    return info;
+}
 
-    for (const auto& file : std::filesystem::directory_iterator{dir}) {
-        if (!IsCacheExpired(file.path().filename().string())) {
-            continue;
-        }
+std::optional<CacheView> CacheHandler::View(const std::string& filename) const {
+    std::optional<CacheView> view = store_->View(filename);
 
-        std::error_code ec;
-        std::filesystem::remove(file, ec);
+    if (!view.has_value()) {
+        store_->Refresh();
+        view = store_->View(filename);
+    }
 
-        if (ec) {
-            return false;
-        }
+    if (view.has_value()) {
+        GetMetrics().Increment(Counter::kCacheBytesRead, view->value.size());
     }
 
-    return true;
+    return view;
 }
 
 } // namespace WayHome
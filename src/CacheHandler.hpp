@@ -1,32 +1,82 @@
 #pragma once
 
+#include "CacheStore.hpp"
+#include "ApiHandler.hpp"
+
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 
 #include <string>
+#include <string_view>
 #include <utility>
+#include <chrono>
+#include <optional>
+#include <memory>
+#include <functional>
 
 namespace WayHome {
 
+// Time spent on sweeping expired entries at startup, the rest is swept in the background
+const std::chrono::milliseconds kCacheStartupSweepBudget{2};
+
+// Entries are kept in a CacheStore located in `cache_dir`.
+// `ttl_seconds` equal to 0 means that entries never expire.
+// Missing and expired entries are looked up again after picking up the writes of other processes.
+// Hits and misses are counted by the callers, once per lookup of theirs, and not here.
 class CacheHandler {
 public:
     CacheHandler(std::string cache_dir, uint32_t ttl_seconds)
         : cache_dir_(std::move(cache_dir))
-        , ttl_seconds_(ttl_seconds) {}
+        , ttl_seconds_(ttl_seconds)
+        , store_(CacheStore::Open(cache_dir_)) {}
 
     CacheHandler() 
         : cache_dir_("./")
-        , ttl_seconds_(0) {};
+        , ttl_seconds_(0)
+        , store_(CacheStore::Open(cache_dir_)) {};
 
     bool IsCacheExpired(const std::string& filename) const;
-    bool UpdateCache(const json& obj, const std::string& filename) const;
+    std::optional<std::chrono::system_clock::time_point> GetExpirationTime(const std::string& filename) const;
+    // `ttl_seconds` overrides the lifetime of this entry only
+    bool UpdateCache(const json& obj, const std::string& filename, std::optional<uint32_t> ttl_seconds = std::nullopt) const;
     bool LoadCache(json& to, const std::string& filename) const;
+    // Passes the entry (an empty object if there is none) to `modify` and stores it if `modify` returns true.
+    // Updates made by other processes in the meantime are not lost. An entry that can't be parsed is left
+    // as it is and the call fails.
+    bool ModifyCache(const std::string& filename, const std::function<bool(json&)>& modify) const;
+
+    // Negative entries: failures that would be repeated by the same request, e.g. unknown names
+    bool RememberFailure(const Error& error, const std::string& filename, uint32_t ttl_seconds) const;
+    std::optional<Error> LoadFailure(const std::string& filename) const;
+
+    // Raw entries, e.g. routes serialized with RoutesHandler::SerializeToBinary
+    bool UpdateCacheBinary(std::string_view data,
+                           const std::string& filename,
+                           std::optional<uint32_t> ttl_seconds = std::nullopt) const;
+    bool LoadCacheBinary(std::string& to, const std::string& filename) const;
+    // Entry bytes mapped from the disk, no copies are made
+    std::optional<CacheView> ViewCache(const std::string& filename) const;
+    // Replaces an existing entry without prolonging its lifetime
+    bool RewriteCacheBinary(std::string_view data, const std::string& filename) const;
+
+    // Moves the entries of the one-file-per-query cache into the store, keeping the time they were written
+    size_t ImportLegacyFiles(const std::function<std::optional<std::string>(std::string_view)>& make_key) const;
+
     bool ClearAllCache() const;
-    bool ClearExpiredCache() const;
+    bool ClearExpiredCache(std::chrono::microseconds budget = std::chrono::microseconds::max()) const;
+    // Entries expired less than `grace` ago are not cleared
+    void SetExpiryGrace(std::chrono::seconds grace) const;
+
+    void SetLimits(const CacheLimits& limits) const;
+    CacheStats GetStats() const;
 
 private:
     std::string cache_dir_;
     uint32_t ttl_seconds_;
+    std::shared_ptr<CacheStore> store_;
+
+    std::optional<CacheEntryInfo> GetInfo(const std::string& filename) const;
+    std::optional<CacheView> View(const std::string& filename) const;
 };
     
 } // namespace WayHome
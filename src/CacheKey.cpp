@@ -0,0 +1,129 @@
+#include "CacheKey.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <format>
+#include <charconv>
+#include <vector>
+
+namespace WayHome {
+
+namespace {
+
+std::string Trim(std::string_view value) {
+    auto is_space = [](char ch) { return std::isspace(static_cast<unsigned char>(ch)); };
+
+    while (!value.empty() && is_space(value.front())) {
+        value.remove_prefix(1);
+    }
+
+    while (!value.empty() && is_space(value.back())) {
+        value.remove_suffix(1);
+    }
+
+    return std::string{value};
+}
+
+std::string ToLower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(),
+        [](char ch) { return std::tolower(static_cast<unsigned char>(ch)); });
+
+    return value;
+}
+
+std::string CanonicalizePoint(std::string_view point) {
+    std::string trimmed = Trim(point);
+
+    // Names are left as typed, their codes are found by CodeSearcher
+    return IsPointCode(trimmed) ? ToLower(std::move(trimmed)) : trimmed;
+}
+
+} // namespace
+
+bool IsPointCode(std::string_view point) {
+    if (point.size() < 2) {
+        return false;
+    }
+
+    char kind = std::tolower(static_cast<unsigned char>(point.front()));
+
+    if (kind != 'c' && kind != 's') {
+        return false;
+    }
+
+    return std::all_of(point.begin() + 1, point.end(),
+        [](char ch) { return std::isdigit(static_cast<unsigned char>(ch)); });
+}
+
+ApiRouteParameters CanonicalizeRouteParameters(ApiRouteParameters parameters) {
+    parameters.from = CanonicalizePoint(parameters.from);
+    parameters.to = CanonicalizePoint(parameters.to);
+    parameters.transport_type = ToLower(Trim(parameters.transport_type));
+    parameters.date = Trim(parameters.date);
+
+    return parameters;
+}
+
+std::string MakeRoutesCacheKey(const ApiRouteParameters& parameters) {
+    ApiRouteParameters canonical = CanonicalizeRouteParameters(parameters);
+
+    return std::format(
+        "{}_{}_{}_{}_{}",
+        canonical.from,
+        canonical.to,
+        canonical.date,
+        canonical.transport_type.empty() ? "all" : canonical.transport_type,
+        canonical.max_transfers == 0 ? "direct" : "transfers"
+    );
+}
+
+std::optional<std::string> MakeRoutesCacheKeyFromLegacyFilename(std::string_view filename) {
+    const std::string_view suffix{"transfers.json"};
+
+    if (!filename.ends_with(suffix)) {
+        return std::nullopt;
+    }
+
+    filename.remove_suffix(suffix.size());
+
+    // from_to_date_transport_N, the transport may be empty
+    std::vector<std::string_view> parts;
+
+    for (size_t start = 0;;) {
+        size_t end = filename.find('_', start);
+        parts.push_back(filename.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start));
+
+        if (end == std::string_view::npos) {
+            break;
+        }
+
+        start = end + 1;
+    }
+
+    uint32_t max_transfers;
+    const std::string_view& transfers = parts.back();
+
+    if (parts.size() != 5 || std::from_chars(transfers.data(), transfers.data() + transfers.size(), max_transfers).ptr
+        != transfers.data() + transfers.size() || transfers.empty()) {
+        return std::nullopt;
+    }
+
+    ApiRouteParameters parameters{
+        std::string{parts[0]}, std::string{parts[1]}, std::string{parts[3]}, std::string{parts[2]}, max_transfers};
+
+    return MakeRoutesCacheKey(parameters);
+}
+
+std::string MakeRoutesPageCacheKey(const ApiRouteParameters& parameters, size_t offset) {
+    return std::format("page:{}_{}", MakeRoutesCacheKey(parameters), offset);
+}
+
+std::string MakeFailureCacheKey(std::string_view key) {
+    return std::format("failed:{}", key);
+}
+
+std::string MakeStationCacheKey(std::string_view name) {
+    return std::format("code:{}", name);
+}
+
+} // namespace WayHome
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "ApiHandler.hpp"
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <optional>
+
+namespace WayHome {
+
+// Station and settlement codes, e.g. c213 or s9600213
+bool IsPointCode(std::string_view point);
+
+// Trims the parameters and brings codes and the transport type to lower case,
+// so equivalent queries are sent to the API and cached the same way
+ApiRouteParameters CanonicalizeRouteParameters(ApiRouteParameters parameters);
+
+// Key of a routes search in the caches. It includes only what the API request depends on:
+// the limit of transfers is reduced to whether transfers are allowed at all
+// and applied to the loaded routes when they are printed.
+std::string MakeRoutesCacheKey(const ApiRouteParameters& parameters);
+
+// Key of the routes cached in `filename` by the one-file-per-query cache, e.g. c213_c2_2025-06-01_train_1transfers.json,
+// std::nullopt for other files
+std::optional<std::string> MakeRoutesCacheKeyFromLegacyFilename(std::string_view filename);
+
+// Key of one page of a search, the merged routes are kept under MakeRoutesCacheKey
+std::string MakeRoutesPageCacheKey(const ApiRouteParameters& parameters, size_t offset);
+
+// Key of the remembered failure of a lookup or search cached under `key`
+std::string MakeFailureCacheKey(std::string_view key);
+
+// Key of the code a station or settlement name was resolved to
+std::string MakeStationCacheKey(std::string_view name);
+
+} // namespace WayHome
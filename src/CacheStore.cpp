@@ -0,0 +1,1259 @@
+#include "CacheStore.hpp"
+#include "Binary.hpp"
+#include "Checksum.hpp"
+#include "Compression.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <vector>
+#include <format>
+#include <charconv>
+#include <tuple>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace WayHome {
+
+namespace {
+
+const uint32_t kRecordMagic = 0x32434857; // "WHC2"
+const uint32_t kIndexMagic = 0x58494857; // "WHIX"
+const uint32_t kIndexVersion = 3;
+
+// magic, crc, sequence, written_at, expires_at, value size, key size, type, flags
+const size_t kRecordHeaderSize = 4 + 4 + 8 + 8 + 8 + 4 + 2 + 1 + 1;
+const size_t kRecordCrcOffset = 8;
+
+const size_t kCompactionBufferBytes = 1024 * 1024;
+
+// Compressed values are prefixed with their raw size
+const uint8_t kRecordCompressed = 1;
+
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t crc;
+    uint64_t sequence;
+    int64_t written_at;
+    int64_t expires_at;
+    uint32_t value_size;
+    uint16_t key_size;
+    uint8_t type;
+    uint8_t flags;
+};
+
+std::string MakeRecord(std::string_view key,
+                       std::string_view value,
+                       uint64_t sequence,
+                       int64_t written_at,
+                       int64_t expires_at,
+                       uint8_t flags) {
+    std::string record;
+    record.reserve(kRecordHeaderSize + key.size() + value.size());
+
+    AppendBinary(record, kRecordMagic);
+    AppendBinary(record, uint32_t{0});
+    AppendBinary(record, sequence);
+    AppendBinary(record, written_at);
+    AppendBinary(record, expires_at);
+    AppendBinary(record, static_cast<uint32_t>(value.size()));
+    AppendBinary(record, static_cast<uint16_t>(key.size()));
+    AppendBinary(record, uint8_t{0});
+    AppendBinary(record, flags);
+
+    record.append(key);
+    record.append(value);
+
+    uint32_t crc = Crc32(std::string_view{record}.substr(kRecordCrcOffset));
+    std::memcpy(record.data() + 4, &crc, sizeof(crc));
+
+    return record;
+}
+
+// Returns the size of the record at the beginning of `data` or 0 if there is no valid record
+size_t ParseRecord(std::string_view data, RecordHeader& header, std::string_view& key, std::string_view& value) {
+    std::string_view reader = data;
+
+    if (!ReadBinary(reader, header.magic)
+    || !ReadBinary(reader, header.crc)
+    || !ReadBinary(reader, header.sequence)
+    || !ReadBinary(reader, header.written_at)
+    || !ReadBinary(reader, header.expires_at)
+    || !ReadBinary(reader, header.value_size)
+    || !ReadBinary(reader, header.key_size)
+    || !ReadBinary(reader, header.type)
+    || !ReadBinary(reader, header.flags)) {
+        return 0;
+    }
+
+    size_t record_size = kRecordHeaderSize + header.key_size + header.value_size;
+
+    if (header.magic != kRecordMagic || data.size() < record_size) {
+        return 0;
+    }
+
+    if (Crc32(data.substr(kRecordCrcOffset, record_size - kRecordCrcOffset)) != header.crc) {
+        return 0;
+    }
+
+    key = reader.substr(0, header.key_size);
+    value = reader.substr(header.key_size, header.value_size);
+
+    return record_size;
+}
+
+uint32_t GetRawSize(const RecordHeader& header, std::string_view value) {
+    uint32_t raw_size = value.size();
+
+    if (header.flags & kRecordCompressed) {
+        ReadBinary(value, raw_size);
+    }
+
+    return raw_size;
+}
+
+bool WriteAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = ::write(fd, data.data(), data.size());
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        data.remove_prefix(written);
+    }
+
+    return true;
+}
+
+bool ReadAll(int fd, std::string& to, uint64_t offset, size_t size) {
+    to.resize(size);
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t read = ::pread(fd, to.data() + done, size - done, offset + done);
+
+        if (read < 0 && errno == EINTR) {
+            continue;
+        } else if (read <= 0) {
+            to.resize(done);
+            return false;
+        }
+
+        done += read;
+    }
+
+    return true;
+}
+
+std::optional<uint32_t> ParseSegmentId(const std::filesystem::path& path) {
+    if (path.extension() != kCacheSegmentExtension) {
+        return std::nullopt;
+    }
+
+    std::string stem = path.stem().string();
+    uint32_t id;
+    auto [ptr, ec] = std::from_chars(stem.data(), stem.data() + stem.size(), id);
+
+    if (ec != std::errc{} || ptr != stem.data() + stem.size() || id == 0) {
+        return std::nullopt;
+    }
+
+    return id;
+}
+
+} // namespace
+
+int64_t GetUnixTime() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+SegmentMapping::~SegmentMapping() {
+    ::munmap(const_cast<char*>(data_), size_);
+}
+
+std::string_view SegmentMapping::GetData() const {
+    return {data_, size_};
+}
+
+std::shared_ptr<CacheStore> CacheStore::Open(const std::string& dir) {
+    static std::mutex registry_mutex;
+    static std::unordered_map<std::string, std::weak_ptr<CacheStore>> registry;
+
+    std::string normalized = std::filesystem::absolute(dir).lexically_normal().string();
+
+    std::lock_guard lock{registry_mutex};
+    std::shared_ptr<CacheStore> store = registry[normalized].lock();
+
+    if (store == nullptr) {
+        store = std::make_shared<CacheStore>(dir);
+        registry[normalized] = store;
+    }
+
+    return store;
+}
+
+CacheStore::CacheStore(std::string dir)
+    : dir_(std::move(dir))
+    , file_lock_(dir_ + '/' + kCacheLockFilename) {
+    Load();
+}
+
+CacheStore::~CacheStore() {
+    if (maintenance_thread_.joinable()) {
+        maintenance_thread_.request_stop();
+        maintenance_thread_.join();
+    }
+
+    if (is_dirty_) {
+        std::shared_lock file_lock{file_lock_};
+        WriteIndex();
+    }
+
+    CloseSegments();
+}
+
+bool CacheStore::Put(const std::string& key, std::string_view value, int64_t written_at, int64_t expires_at) {
+    // The lock file lives in the directory
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+
+    std::unique_lock file_lock{file_lock_};
+
+    {
+        std::unique_lock lock{mutex_};
+        CatchUp(true);
+    }
+
+    return Append(key, value, written_at, expires_at);
+}
+
+bool CacheStore::Modify(const std::string& key,
+                        const std::function<std::optional<std::string>(std::optional<std::string_view>)>& modify,
+                        int64_t written_at,
+                        int64_t expires_at) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+
+    std::unique_lock file_lock{file_lock_};
+
+    {
+        std::unique_lock lock{mutex_};
+        CatchUp(true);
+    }
+
+    std::optional<CacheView> current = View(key);
+    std::optional<std::string> value = modify(
+        current.has_value() ? std::optional<std::string_view>{current->value} : std::nullopt);
+
+    if (!value.has_value()) {
+        return false;
+    }
+
+    return Append(key, value.value(), written_at, expires_at);
+}
+
+size_t CacheStore::ImportFiles(const std::function<std::optional<std::string>(std::string_view)>& make_key,
+                               uint32_t ttl_seconds) {
+    std::error_code ec;
+    std::vector<std::pair<std::filesystem::path, std::string>> files;
+
+    // Looked for without the lock, there is nothing to import after the first run
+    for (const auto& entry : std::filesystem::directory_iterator{dir_, ec}) {
+        std::optional<std::string> key = make_key(entry.path().filename().string());
+
+        if (key.has_value() && entry.is_regular_file(ec)) {
+            files.emplace_back(entry.path(), std::move(key.value()));
+        }
+    }
+
+    if (files.empty()) {
+        return 0;
+    }
+
+    std::unique_lock file_lock{file_lock_};
+
+    {
+        std::unique_lock lock{mutex_};
+        CatchUp(true);
+    }
+
+    int64_t now = GetUnixTime();
+    size_t imported = 0;
+
+    for (const auto& [path, key] : files) {
+        std::ifstream file{path, std::ios::binary};
+        std::string value{std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+        auto write_time = std::filesystem::last_write_time(path, ec);
+
+        // Already imported by another process
+        if (!file.is_open() || file.bad() || ec) {
+            continue;
+        }
+
+        auto system_write_time = std::chrono::system_clock::now() - (std::filesystem::file_time_type::clock::now() - write_time);
+        int64_t written_at = std::chrono::duration_cast<std::chrono::seconds>(system_write_time.time_since_epoch()).count();
+        int64_t expires_at = ttl_seconds == 0 ? kCacheNeverExpires : written_at + ttl_seconds;
+
+        bool is_newer_stored;
+
+        {
+            std::shared_lock lock{mutex_};
+            auto it = index_.find(key);
+            is_newer_stored = it != index_.end() && it->second.written_at >= written_at;
+        }
+
+        bool is_expired = expires_at != kCacheNeverExpires && expires_at <= now;
+
+        if (!is_newer_stored && !is_expired) {
+            if (!Append(key, value, written_at, expires_at)) {
+                continue;
+            }
+
+            ++imported;
+        }
+
+        std::filesystem::remove(path, ec);
+    }
+
+    return imported;
+}
+
+bool CacheStore::Append(const std::string& key, std::string_view value, int64_t written_at, int64_t expires_at) {
+    if (key.size() > UINT16_MAX || value.size() > UINT32_MAX) {
+        return false;
+    }
+
+    uint8_t flags = 0;
+    std::string compressed;
+
+    if (is_compression_enabled_ && value.size() >= kCacheCompressionMinBytes) {
+        std::optional<std::string> deflated = Compress(value);
+
+        if (deflated.has_value() && deflated->size() + sizeof(uint32_t) < value.size()) {
+            AppendBinary(compressed, static_cast<uint32_t>(value.size()));
+            compressed.append(deflated.value());
+            flags |= kRecordCompressed;
+        }
+    }
+
+    std::unique_lock lock{mutex_};
+
+    if (!OpenActiveSegment()) {
+        return false;
+    }
+
+    Segment& segment = segments_[active_segment_];
+    std::string record = MakeRecord(
+        key, (flags & kRecordCompressed) ? compressed : value, next_sequence_, written_at, expires_at, flags);
+
+    if (!WriteAll(segment.fd, record)) {
+        ::ftruncate(segment.fd, segment.size);
+        return false;
+    }
+
+    Location location{
+        active_segment_, segment.size, static_cast<uint32_t>(record.size()), next_sequence_, written_at, expires_at,
+        static_cast<uint32_t>(value.size()), GetUnixTime(), 0};
+
+    ApplyRecord(key, location);
+
+    segment.size += record.size();
+    ++next_sequence_;
+    is_dirty_ = true;
+
+    EvictOverBudget(key);
+
+    return true;
+}
+
+std::optional<CacheView> CacheStore::View(const std::string& key) const {
+    std::shared_lock lock{mutex_};
+
+    auto it = index_.find(key);
+
+    if (it == index_.end()) {
+        return std::nullopt;
+    }
+
+    const Location& location = it->second;
+    auto segment_it = segments_.find(location.segment);
+
+    if (segment_it == segments_.end()) {
+        return std::nullopt;
+    }
+
+    std::shared_ptr<const SegmentMapping> mapping = MapSegment(segment_it->second, location.offset + location.size);
+
+    if (mapping == nullptr) {
+        return std::nullopt;
+    }
+
+    std::string_view record = mapping->GetData().substr(location.offset, location.size);
+
+    RecordHeader header;
+    std::string_view record_key;
+    std::string_view value;
+
+    if (ParseRecord(record, header, record_key, value) != location.size
+    || record_key != key
+    || header.sequence != location.sequence) {
+        return std::nullopt;
+    }
+
+    {
+        std::lock_guard access_lock{access_mutex_};
+        location.last_access = GetUnixTime();
+        ++location.hits;
+    }
+
+    if (!(header.flags & kRecordCompressed)) {
+        return CacheView{std::move(mapping), value, nullptr};
+    }
+
+    uint32_t raw_size;
+
+    if (!ReadBinary(value, raw_size)) {
+        return std::nullopt;
+    }
+
+    std::optional<std::string> decompressed = Decompress(value, raw_size);
+
+    if (!decompressed.has_value()) {
+        return std::nullopt;
+    }
+
+    auto buffer = std::make_shared<const std::string>(std::move(decompressed.value()));
+    return CacheView{nullptr, *buffer, buffer};
+}
+
+std::optional<CacheEntryInfo> CacheStore::GetInfo(const std::string& key) const {
+    std::shared_lock lock{mutex_};
+
+    auto it = index_.find(key);
+
+    if (it == index_.end()) {
+        return std::nullopt;
+    }
+
+    return CacheEntryInfo{it->second.written_at, it->second.expires_at, it->second.size, it->second.raw_size};
+}
+
+size_t CacheStore::EraseExpired(int64_t now, std::chrono::microseconds budget, std::stop_token stop_token) {
+    now -= expiry_grace_;
+    auto deadline = std::chrono::steady_clock::now() + std::min(budget, std::chrono::microseconds{std::chrono::hours{1}});
+
+    std::unique_lock lock{mutex_};
+    size_t erased = 0;
+
+    while (HasExpired(now) && !stop_token.stop_requested()) {
+        EraseEntry(index_.find(expiry_.begin()->second));
+        ++erased;
+
+        if (erased % 64 == 0 && std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+    }
+
+    is_dirty_ |= erased != 0;
+    return erased;
+}
+
+void CacheStore::SetExpiryGrace(std::chrono::seconds grace) {
+    expiry_grace_ = grace.count();
+}
+
+bool CacheStore::Clear() {
+    std::lock_guard compaction_lock{compaction_mutex_};
+    std::unique_lock file_lock{file_lock_};
+    std::unique_lock lock{mutex_};
+
+    CloseSegments();
+
+    index_.clear();
+    expiry_.clear();
+    segments_.clear();
+    active_segment_ = 0;
+    is_dirty_ = false;
+
+    // The lock file stays, other processes may be waiting on it
+    std::error_code ec;
+    bool is_cleared = true;
+
+    for (const auto& entry : std::filesystem::directory_iterator{dir_, ec}) {
+        if (entry.path().filename() != kCacheLockFilename) {
+            is_cleared &= std::filesystem::remove_all(entry.path(), ec) != static_cast<std::uintmax_t>(-1);
+        }
+    }
+
+    return is_cleared;
+}
+
+bool CacheStore::Flush() const {
+    std::shared_lock file_lock{file_lock_};
+    std::unique_lock lock{mutex_};
+
+    if (!is_dirty_) {
+        return true;
+    }
+
+    return WriteIndex();
+}
+
+void CacheStore::Refresh() {
+    std::shared_lock file_lock{file_lock_};
+    std::unique_lock lock{mutex_};
+
+    CatchUp(false);
+}
+
+size_t CacheStore::GetSize() const {
+    std::shared_lock lock{mutex_};
+    return index_.size();
+}
+
+void CacheStore::SetLimits(const CacheLimits& limits) {
+    std::unique_lock lock{mutex_};
+
+    limits_ = limits;
+    is_compression_enabled_ = limits.compression;
+
+    EvictOverBudget({});
+}
+
+CacheStats CacheStore::GetStats() const {
+    std::shared_lock lock{mutex_};
+
+    CacheStats stats;
+    stats.entries = index_.size();
+    stats.max_entries = limits_.max_entries;
+    stats.max_bytes = limits_.max_bytes;
+    stats.eviction_policy = limits_.eviction_policy;
+    stats.evictions = evictions_;
+    stats.segments = segments_.size();
+
+    for (const auto& [id, segment] : segments_) {
+        stats.stored_bytes += segment.live_bytes;
+        stats.disk_bytes += segment.size;
+    }
+
+    for (const auto& [key, location] : index_) {
+        stats.raw_bytes += location.raw_size;
+
+        if (location.raw_size + kRecordHeaderSize + key.size() > location.size) {
+            ++stats.compressed_entries;
+        }
+    }
+
+    return stats;
+}
+
+void CacheStore::MaintainAsync() {
+    bool expected = false;
+
+    if (!is_maintaining_.compare_exchange_strong(expected, true)) {
+        return;
+    }
+
+    {
+        std::shared_lock lock{mutex_};
+
+        if (!HasExpired(GetUnixTime() - expiry_grace_) && GetGarbageBytes() < kCacheCompactionMinGarbage) {
+            is_maintaining_ = false;
+            return;
+        }
+    }
+
+    if (maintenance_thread_.joinable()) {
+        maintenance_thread_.join();
+    }
+
+    maintenance_thread_ = std::jthread{[this](std::stop_token stop_token) {
+        // Short slices let lookups through between them
+        while (!stop_token.stop_requested() && EraseExpired(GetUnixTime(), kCacheSweepSlice, stop_token) != 0) {}
+
+        bool has_garbage;
+
+        {
+            std::shared_lock lock{mutex_};
+            has_garbage = GetGarbageBytes() >= kCacheCompactionMinGarbage;
+        }
+
+        if (has_garbage && !stop_token.stop_requested()) {
+            Compact(stop_token);
+        }
+
+        is_maintaining_ = false;
+    }};
+}
+
+bool CacheStore::Compact(std::stop_token stop_token) {
+    // Writers wait for the whole compaction, so no process appends to a segment being copied
+    // and no process takes the id of the output segment
+    std::lock_guard compaction_lock{compaction_mutex_};
+    std::unique_lock file_lock{file_lock_};
+
+    std::vector<std::pair<std::string, Location>> live;
+    std::vector<uint32_t> victims;
+    std::map<uint32_t, int> victim_fds;
+    uint32_t output_id;
+
+    {
+        std::unique_lock lock{mutex_};
+        CatchUp(true);
+
+        for (const auto& [id, segment] : segments_) {
+            if (id != active_segment_ && segment.fd != -1 && segment.size > segment.live_bytes) {
+                victims.push_back(id);
+                victim_fds[id] = segment.fd;
+            }
+        }
+
+        if (victims.empty()) {
+            return true;
+        }
+
+        for (const auto& [key, location] : index_) {
+            if (victim_fds.contains(location.segment)) {
+                live.emplace_back(key, location);
+            }
+        }
+
+        // Reserve the id, the segment becomes visible once it's complete
+        output_id = segments_.rbegin()->first + 1;
+        segments_[output_id] = Segment{};
+    }
+
+    std::sort(live.begin(), live.end(), [](const auto& lhs, const auto& rhs) {
+        return std::tie(lhs.second.segment, lhs.second.offset) < std::tie(rhs.second.segment, rhs.second.offset);
+    });
+
+    std::string output_path = GetSegmentPath(output_id);
+    std::string temp_path = output_path + ".tmp";
+    // The output becomes the segment other processes append to, so it's opened for appending as well
+    int output_fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+
+    auto abort_compaction = [&] {
+        if (output_fd != -1) {
+            ::close(output_fd);
+        }
+
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+
+        std::unique_lock lock{mutex_};
+        segments_.erase(output_id);
+
+        return false;
+    };
+
+    if (output_fd == -1) {
+        return abort_compaction();
+    }
+
+    std::vector<std::pair<std::string, Location>> moved;
+    moved.reserve(live.size());
+
+    std::string buffer;
+    std::string record;
+    uint64_t output_size = 0;
+
+    for (const auto& [key, location] : live) {
+        if (stop_token.stop_requested()) {
+            return abort_compaction();
+        }
+
+        RecordHeader header;
+        std::string_view record_key;
+        std::string_view value;
+
+        if (!ReadAll(victim_fds[location.segment], record, location.offset, location.size)
+        || ParseRecord(record, header, record_key, value) != location.size) {
+            continue;
+        }
+
+        Location new_location = location;
+        new_location.segment = output_id;
+        new_location.offset = output_size + buffer.size();
+
+        buffer.append(record);
+        moved.emplace_back(key, new_location);
+
+        if (buffer.size() >= kCompactionBufferBytes) {
+            if (!WriteAll(output_fd, buffer)) {
+                return abort_compaction();
+            }
+
+            output_size += buffer.size();
+            buffer.clear();
+        }
+    }
+
+    if (!WriteAll(output_fd, buffer) || ::fsync(output_fd) != 0) {
+        return abort_compaction();
+    }
+
+    output_size += buffer.size();
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, output_path, ec);
+
+    if (ec) {
+        return abort_compaction();
+    }
+
+    std::unique_lock lock{mutex_};
+
+    struct stat output_stat;
+
+    Segment& output = segments_[output_id];
+    output.fd = output_fd;
+    output.inode = ::fstat(output_fd, &output_stat) == 0 ? output_stat.st_ino : 0;
+    output.size = output_size;
+
+    for (auto& [key, new_location] : moved) {
+        auto it = index_.find(key);
+
+        // The key could have been overwritten or erased while the records were copied
+        if (it == index_.end() || it->second.sequence != new_location.sequence) {
+            continue;
+        }
+
+        it->second.segment = new_location.segment;
+        it->second.offset = new_location.offset;
+        output.live_bytes += new_location.size;
+    }
+
+    for (uint32_t id : victims) {
+        ::close(segments_[id].fd);
+        segments_.erase(id);
+        std::filesystem::remove(GetSegmentPath(id), ec);
+    }
+
+    is_dirty_ = true;
+    return WriteIndex();
+}
+
+std::string CacheStore::GetSegmentPath(uint32_t id) const {
+    return std::format("{}/{:06}{}", dir_, id, kCacheSegmentExtension);
+}
+
+std::string CacheStore::GetIndexPath() const {
+    return dir_ + '/' + kCacheIndexFilename;
+}
+
+void CacheStore::Load() {
+    std::error_code ec;
+
+    if (!std::filesystem::is_directory(dir_, ec)) {
+        return;
+    }
+
+    // Exclusively, so torn tails are left by crashed writers and not by the ones still writing
+    std::unique_lock file_lock{file_lock_};
+
+    std::map<uint32_t, uint64_t> covered;
+    LoadIndex(covered);
+
+    for (const auto& entry : std::filesystem::directory_iterator{dir_, ec}) {
+        const std::filesystem::path& path = entry.path();
+        std::string filename = path.filename().string();
+
+        if ((filename.starts_with(kCacheIndexFilename + '.') && path.extension() == ".tmp")
+        || (path.extension() == ".tmp" && ParseSegmentId(path.stem()).has_value())) {
+            // Leftovers of an interrupted write, the files of the previous cache are left for ImportFiles
+            std::filesystem::remove(path, ec);
+        }
+    }
+
+    CatchUp(true, covered);
+
+    EraseEntriesIf([this](const Location& location) { return !segments_.contains(location.segment); });
+
+    for (auto& [id, segment] : segments_) {
+        segment.live_bytes = 0;
+    }
+
+    for (const auto& [key, location] : index_) {
+        segments_[location.segment].live_bytes += location.size;
+        next_sequence_ = std::max(next_sequence_, location.sequence + 1);
+    }
+}
+
+bool CacheStore::LoadIndex(std::map<uint32_t, uint64_t>& covered) {
+    int fd = ::open(GetIndexPath().c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(GetIndexPath(), ec);
+    std::string data;
+    bool is_read = !ec && size >= sizeof(uint32_t) && ReadAll(fd, data, 0, size);
+    ::close(fd);
+
+    if (!is_read) {
+        return false;
+    }
+
+    std::string_view body{data.data(), data.size() - sizeof(uint32_t)};
+    std::string_view crc_view{data.data() + body.size(), sizeof(uint32_t)};
+    uint32_t crc;
+
+    if (!ReadBinary(crc_view, crc) || Crc32(body) != crc) {
+        return false;
+    }
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t segments_count;
+
+    if (!ReadBinary(body, magic) || !ReadBinary(body, version) || magic != kIndexMagic || version != kIndexVersion
+    || !ReadBinary(body, next_sequence_) || !ReadBinary(body, segments_count)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < segments_count; ++i) {
+        uint32_t id;
+        uint64_t covered_size;
+
+        if (!ReadBinary(body, id) || !ReadBinary(body, covered_size)) {
+            covered.clear();
+            return false;
+        }
+
+        covered[id] = covered_size;
+    }
+
+    uint32_t entries_count;
+
+    if (!ReadBinary(body, entries_count)) {
+        covered.clear();
+        return false;
+    }
+
+    index_.reserve(entries_count);
+
+    for (uint32_t i = 0; i < entries_count; ++i) {
+        std::string key;
+        Location location;
+
+        if (!ReadBinary(body, key)
+        || !ReadBinary(body, location.segment)
+        || !ReadBinary(body, location.offset)
+        || !ReadBinary(body, location.size)
+        || !ReadBinary(body, location.sequence)
+        || !ReadBinary(body, location.written_at)
+        || !ReadBinary(body, location.expires_at)
+        || !ReadBinary(body, location.raw_size)
+        || !ReadBinary(body, location.last_access)
+        || !ReadBinary(body, location.hits)) {
+            index_.clear();
+            expiry_.clear();
+            covered.clear();
+            return false;
+        }
+
+        // Expiring entries are stored in the expiration order, so they are appended to the set
+        if (location.expires_at != kCacheNeverExpires) {
+            expiry_.emplace_hint(expiry_.end(), location.expires_at, key);
+        }
+
+        index_[std::move(key)] = location;
+    }
+
+    return true;
+}
+
+bool CacheStore::WriteIndex() const {
+    std::error_code ec;
+
+    if (!std::filesystem::is_directory(dir_, ec)) {
+        return true;
+    }
+
+    std::string data;
+
+    AppendBinary(data, kIndexMagic);
+    AppendBinary(data, kIndexVersion);
+    AppendBinary(data, next_sequence_);
+
+    uint32_t segments_count = std::count_if(segments_.begin(), segments_.end(),
+        [](const auto& item) { return item.second.fd != -1; });
+
+    AppendBinary(data, segments_count);
+
+    for (const auto& [id, segment] : segments_) {
+        if (segment.fd != -1) {
+            AppendBinary(data, id);
+            AppendBinary(data, segment.size);
+        }
+    }
+
+    AppendBinary(data, static_cast<uint32_t>(index_.size()));
+
+    auto append_entry = [&data](const std::string& key, const Location& location) {
+        AppendBinary(data, std::string_view{key});
+        AppendBinary(data, location.segment);
+        AppendBinary(data, location.offset);
+        AppendBinary(data, location.size);
+        AppendBinary(data, location.sequence);
+        AppendBinary(data, location.written_at);
+        AppendBinary(data, location.expires_at);
+        AppendBinary(data, location.raw_size);
+        AppendBinary(data, location.last_access);
+        AppendBinary(data, location.hits);
+    };
+
+    for (const auto& [expires_at, key] : expiry_) {
+        append_entry(key, index_.at(key));
+    }
+
+    for (const auto& [key, location] : index_) {
+        if (location.expires_at == kCacheNeverExpires) {
+            append_entry(key, location);
+        }
+    }
+
+    AppendBinary(data, Crc32(data));
+
+    // Other processes may be writing their checkpoints at the same time
+    std::string temp_path = std::format("{}.{}.tmp", GetIndexPath(), ::getpid());
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    bool is_written = WriteAll(fd, data);
+    ::close(fd);
+
+    if (is_written) {
+        std::filesystem::rename(temp_path, GetIndexPath(), ec);
+    }
+
+    if (!is_written || ec) {
+        std::filesystem::remove(temp_path, ec);
+        return false;
+    }
+
+    is_dirty_ = false;
+    return true;
+}
+
+void CacheStore::CatchUp(bool can_truncate, const std::map<uint32_t, uint64_t>& covered) {
+    std::error_code ec;
+    std::map<uint32_t, uint64_t> on_disk;
+
+    for (const auto& entry : std::filesystem::directory_iterator{dir_, ec}) {
+        std::optional<uint32_t> id = ParseSegmentId(entry.path());
+        struct stat file_stat;
+
+        if (id.has_value() && ::stat(entry.path().c_str(), &file_stat) == 0) {
+            on_disk[id.value()] = file_stat.st_ino;
+        }
+    }
+
+    if (ec) {
+        return;
+    }
+
+    // Removed by the compaction or clearing of another process. Moved records are replayed
+    // from their new segment below, the rest was dropped by that process anyway.
+    std::vector<uint32_t> gone;
+
+    for (const auto& [id, segment] : segments_) {
+        auto it = on_disk.find(id);
+
+        if (segment.fd != -1 && (it == on_disk.end() || it->second != segment.inode)) {
+            gone.push_back(id);
+        }
+    }
+
+    if (!gone.empty()) {
+        EraseEntriesIf([&gone](const Location& location) {
+            return std::find(gone.begin(), gone.end(), location.segment) != gone.end();
+        });
+
+        for (uint32_t id : gone) {
+            ::close(segments_[id].fd);
+            segments_.erase(id);
+        }
+
+        is_dirty_ = true;
+    }
+
+    for (const auto& [id, inode] : on_disk) {
+        auto [it, is_new] = segments_.try_emplace(id);
+        Segment& segment = it->second;
+
+        if (is_new) {
+            int fd = ::open(GetSegmentPath(id).c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+
+            if (fd == -1) {
+                segments_.erase(it);
+                continue;
+            }
+
+            segment.fd = fd;
+            segment.inode = inode;
+
+            auto covered_it = covered.find(id);
+            segment.size = covered_it == covered.end() ? 0 : covered_it->second;
+        }
+
+        struct stat file_stat;
+
+        if (::fstat(segment.fd, &file_stat) != 0) {
+            continue;
+        }
+
+        uint64_t file_size = file_stat.st_size;
+
+        if (segment.size > file_size) {
+            EraseEntriesIf([id](const Location& location) { return location.segment == id; });
+            segment.size = 0;
+        }
+
+        if (segment.size == file_size) {
+            continue;
+        }
+
+        uint64_t valid_end = ReplaySegment(id, segment.size, file_size);
+
+        if (valid_end < file_size && can_truncate) {
+            // A torn record at the tail, the rest of the segment is unreachable
+            ::ftruncate(segment.fd, valid_end);
+        }
+
+        segment.size = valid_end;
+        is_dirty_ = true;
+    }
+
+    active_segment_ = segments_.empty() ? 0 : segments_.rbegin()->first;
+}
+
+uint64_t CacheStore::ReplaySegment(uint32_t id, uint64_t from, uint64_t to) {
+    std::string data;
+
+    ReadAll(segments_[id].fd, data, from, to - from);
+
+    std::string_view rest{data};
+    uint64_t offset = from;
+
+    while (!rest.empty()) {
+        RecordHeader header;
+        std::string_view key;
+        std::string_view value;
+
+        size_t record_size = ParseRecord(rest, header, key, value);
+
+        if (record_size == 0) {
+            break;
+        }
+
+        ApplyRecord(std::string{key}, Location{
+            id, offset, static_cast<uint32_t>(record_size), header.sequence, header.written_at, header.expires_at,
+            GetRawSize(header, value), header.written_at, 0});
+
+        offset += record_size;
+        rest.remove_prefix(record_size);
+    }
+
+    return offset;
+}
+
+void CacheStore::ApplyRecord(const std::string& key, const Location& location) {
+    next_sequence_ = std::max(next_sequence_, location.sequence + 1);
+
+    auto it = index_.find(key);
+
+    if (it != index_.end()) {
+        if (it->second.sequence > location.sequence) {
+            return;
+        }
+
+        EraseEntry(it);
+    }
+
+    index_.emplace(key, location);
+
+    if (location.expires_at != kCacheNeverExpires) {
+        expiry_.emplace(location.expires_at, key);
+    }
+
+    auto segment_it = segments_.find(location.segment);
+
+    if (segment_it != segments_.end()) {
+        segment_it->second.live_bytes += location.size;
+    }
+}
+
+void CacheStore::RemoveLiveBytes(const Location& location) {
+    auto segment_it = segments_.find(location.segment);
+
+    if (segment_it != segments_.end() && segment_it->second.live_bytes >= location.size) {
+        segment_it->second.live_bytes -= location.size;
+    }
+}
+
+void CacheStore::EraseEntry(std::unordered_map<std::string, Location>::iterator it) {
+    RemoveLiveBytes(it->second);
+
+    if (it->second.expires_at != kCacheNeverExpires) {
+        expiry_.erase({it->second.expires_at, it->first});
+    }
+
+    index_.erase(it);
+}
+
+void CacheStore::EraseEntriesIf(const std::function<bool(const Location&)>& predicate) {
+    for (auto it = index_.begin(); it != index_.end();) {
+        auto next = std::next(it);
+
+        if (predicate(it->second)) {
+            EraseEntry(it);
+        }
+
+        it = next;
+    }
+}
+
+bool CacheStore::HasExpired(int64_t now) const {
+    return !expiry_.empty() && expiry_.begin()->first <= now;
+}
+
+std::shared_ptr<const SegmentMapping> CacheStore::MapSegment(const Segment& segment, uint64_t min_size) const {
+    std::lock_guard lock{mapping_mutex_};
+
+    if (segment.mapping != nullptr && segment.mapping->GetData().size() >= min_size) {
+        return segment.mapping;
+    }
+
+    if (segment.fd == -1 || segment.size < min_size) {
+        return nullptr;
+    }
+
+    void* data = ::mmap(nullptr, segment.size, PROT_READ, MAP_SHARED, segment.fd, 0);
+
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+
+    segment.mapping = std::make_shared<const SegmentMapping>(static_cast<const char*>(data), segment.size);
+    return segment.mapping;
+}
+
+bool CacheStore::OpenActiveSegment() {
+    auto it = segments_.find(active_segment_);
+
+    if (it != segments_.end() && it->second.fd != -1 && it->second.size < kCacheSegmentMaxBytes) {
+        return true;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+
+    if (ec) {
+        return false;
+    }
+
+    uint32_t id = segments_.empty() ? 1 : segments_.rbegin()->first + 1;
+    int fd = ::open(GetSegmentPath(id).c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat file_stat;
+
+    segments_[id].fd = fd;
+    segments_[id].inode = ::fstat(fd, &file_stat) == 0 ? file_stat.st_ino : 0;
+    active_segment_ = id;
+
+    return true;
+}
+
+void CacheStore::CloseSegments() {
+    for (auto& [id, segment] : segments_) {
+        if (segment.fd != -1) {
+            ::close(segment.fd);
+            segment.fd = -1;
+        }
+
+        segment.mapping.reset();
+    }
+}
+
+void CacheStore::EvictOverBudget(const std::string& keep_key) {
+    uint64_t live_bytes = 0;
+
+    for (const auto& [id, segment] : segments_) {
+        live_bytes += segment.live_bytes;
+    }
+
+    if (index_.size() <= limits_.max_entries && live_bytes <= limits_.max_bytes) {
+        return;
+    }
+
+    // Evicting a bit below the limits spreads the cost of sorting over the following writes
+    size_t target_entries = limits_.max_entries - limits_.max_entries / 10;
+    uint64_t target_bytes = limits_.max_bytes - limits_.max_bytes / 10;
+
+    std::vector<std::unordered_map<std::string, Location>::iterator> candidates;
+    candidates.reserve(index_.size());
+
+    for (auto it = index_.begin(); it != index_.end(); ++it) {
+        if (it->first != keep_key) {
+            candidates.push_back(it);
+        }
+    }
+
+    if (limits_.eviction_policy == EvictionPolicy::kLfu) {
+        std::sort(candidates.begin(), candidates.end(), [](auto lhs, auto rhs) {
+            return std::tie(lhs->second.hits, lhs->second.last_access, lhs->second.sequence)
+                < std::tie(rhs->second.hits, rhs->second.last_access, rhs->second.sequence);
+        });
+    } else {
+        std::sort(candidates.begin(), candidates.end(), [](auto lhs, auto rhs) {
+            return std::tie(lhs->second.last_access, lhs->second.sequence)
+                < std::tie(rhs->second.last_access, rhs->second.sequence);
+        });
+    }
+
+    for (auto it : candidates) {
+        if (index_.size() <= target_entries && live_bytes <= target_bytes) {
+            break;
+        }
+
+        live_bytes -= it->second.size;
+        EraseEntry(it);
+        ++evictions_;
+    }
+
+    is_dirty_ = true;
+}
+
+uint64_t CacheStore::GetGarbageBytes() const {
+    uint64_t garbage = 0;
+
+    for (const auto& [id, segment] : segments_) {
+        if (id != active_segment_) {
+            garbage += segment.size - segment.live_bytes;
+        }
+    }
+
+    return garbage;
+}
+
+} // namespace WayHome
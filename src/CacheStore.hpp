@@ -0,0 +1,260 @@
+#pragma once
+
+#include "FileLock.hpp"
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <map>
+#include <set>
+#include <chrono>
+#include <memory>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <stop_token>
+#include <functional>
+#include <cstdint>
+
+namespace WayHome {
+
+const std::string kCacheIndexFilename{"index"};
+const std::string kCacheSegmentExtension{".log"};
+const std::string kCacheLockFilename{"lock"};
+
+const uint64_t kCacheSegmentMaxBytes = 8 * 1024 * 1024;
+const uint64_t kCacheCompactionMinGarbage = 1024 * 1024;
+
+const int64_t kCacheNeverExpires = 0;
+const size_t kCacheCompressionMinBytes = 512;
+const std::chrono::milliseconds kCacheSweepSlice{1};
+
+// Seconds since the epoch, the time unit of the cache
+int64_t GetUnixTime();
+
+// Read-only memory mapping of a segment file
+class SegmentMapping {
+public:
+    SegmentMapping(const char* data, size_t size)
+        : data_(data)
+        , size_(size) {}
+
+    ~SegmentMapping();
+
+    SegmentMapping(const SegmentMapping&) = delete;
+    SegmentMapping& operator=(const SegmentMapping&) = delete;
+
+    std::string_view GetData() const;
+
+private:
+    const char* data_;
+    size_t size_;
+};
+
+// Value of an entry pointing straight into the mapped segment, or into a buffer owned
+// by the view if the value is compressed. Stays valid while the view is alive.
+struct CacheView {
+    std::shared_ptr<const SegmentMapping> mapping;
+    std::string_view value;
+    std::shared_ptr<const std::string> buffer;
+};
+
+struct CacheEntryInfo {
+    int64_t written_at;
+    int64_t expires_at;
+    uint32_t size;
+    uint32_t raw_size;
+};
+
+enum class EvictionPolicy {
+    kLru,
+    kLfu
+};
+
+struct CacheLimits {
+    uint64_t max_bytes = 256 * 1024 * 1024;
+    size_t max_entries = 100000;
+    EvictionPolicy eviction_policy = EvictionPolicy::kLru;
+    bool compression = true;
+};
+
+struct CacheStats {
+    size_t entries = 0;
+    size_t max_entries = 0;
+    size_t compressed_entries = 0;
+    size_t segments = 0;
+
+    // Records of live entries on the disk and their values before compression
+    uint64_t stored_bytes = 0;
+    uint64_t raw_bytes = 0;
+    // Segments including the garbage waiting for compaction
+    uint64_t disk_bytes = 0;
+    uint64_t max_bytes = 0;
+
+    uint64_t evictions = 0;
+    EvictionPolicy eviction_policy = EvictionPolicy::kLru;
+};
+
+// Append-only, segment based key-value store used by CacheHandler.
+//
+// Values are appended as checksummed records to segment files in the cache directory.
+// A key -> location index is kept in memory and checkpointed to the index file,
+// so opening the store reads one file plus the segment tails written after the checkpoint.
+// Records carry a sequence number, the newest record of a key wins regardless of its segment.
+// Reads map the segments into memory and hand out views without copying the values.
+// Values above kCacheCompressionMinBytes are deflated if that makes them smaller.
+// Live records are kept within CacheLimits by evicting the least recently or least frequently
+// used entries; the access statistics are persisted in the index file.
+// Entries are also ordered by their expiration time, so expired ones are popped
+// from the front without looking at the rest. The order is kept in the index file.
+// Overwritten and expired records are dropped by the compaction which copies live records
+// into a new segment in a background thread.
+//
+// Several processes may use the same directory. Appends, compaction and clearing hold an exclusive
+// lock on the lock file and first replay the records other processes appended since the last look,
+// so sequence numbers stay unique and records only ever go to the newest segment.
+// Readers don't lock, a miss can be retried after Refresh. Files that are rewritten as a whole
+// are written to a temporary file and renamed over the old one.
+class CacheStore {
+public:
+    // Stores are shared between all users of the same directory in the process
+    static std::shared_ptr<CacheStore> Open(const std::string& dir);
+
+    explicit CacheStore(std::string dir);
+    ~CacheStore();
+
+    CacheStore(const CacheStore&) = delete;
+    CacheStore& operator=(const CacheStore&) = delete;
+
+    bool Put(const std::string& key, std::string_view value, int64_t written_at, int64_t expires_at);
+    // Stores the value returned by `modify` for the current value of the key, nothing is stored for std::nullopt.
+    // No other process or thread writes in between, so read-modify-write cycles don't lose updates.
+    bool Modify(const std::string& key,
+                const std::function<std::optional<std::string>(std::optional<std::string_view>)>& modify,
+                int64_t written_at,
+                int64_t expires_at);
+    std::optional<CacheView> View(const std::string& key) const;
+    std::optional<CacheEntryInfo> GetInfo(const std::string& key) const;
+
+    // Drops entries that are due at `now` from the index until the time budget runs out or a stop is requested,
+    // doesn't touch the disk. Returns the number of dropped entries.
+    size_t EraseExpired(int64_t now,
+                        std::chrono::microseconds budget = std::chrono::microseconds::max(),
+                        std::stop_token stop_token = {});
+    // Expired entries are kept for `grace` more seconds, so they can still be served as stale
+    void SetExpiryGrace(std::chrono::seconds grace);
+
+    bool Clear();
+
+    // Moves the files of the one-file-per-query cache into the store. A file is imported under the key
+    // `make_key` returns for its name, files it returns std::nullopt for are not touched.
+    // Entries expire `ttl_seconds` after the file was last written, the expired ones are just removed.
+    // Returns the number of imported entries.
+    size_t ImportFiles(const std::function<std::optional<std::string>(std::string_view)>& make_key, uint32_t ttl_seconds);
+
+    bool Flush() const;
+
+    // Picks up the records written by other processes since the last look
+    void Refresh();
+
+    // Sweeps the remaining expired entries in slices and compacts the segments
+    // if enough garbage has accumulated, all in a background thread.
+    // Destroying the store stops the thread between records, the rest is left for the next run.
+    void MaintainAsync();
+    // A stopped compaction leaves the segments as they were
+    bool Compact(std::stop_token stop_token = {});
+
+    size_t GetSize() const;
+
+    void SetLimits(const CacheLimits& limits);
+    CacheStats GetStats() const;
+
+private:
+    struct Location {
+        uint32_t segment;
+        uint64_t offset;
+        uint32_t size;
+        uint64_t sequence;
+        int64_t written_at;
+        int64_t expires_at;
+        uint32_t raw_size;
+
+        // Updated by readers under access_mutex_
+        mutable int64_t last_access;
+        mutable uint32_t hits;
+    };
+
+    struct Segment {
+        int fd = -1;
+        // Tells a segment replaced by another process from the one that was opened
+        uint64_t inode = 0;
+        uint64_t size = 0;
+        uint64_t live_bytes = 0;
+
+        // Covers the segment as it was at the time of mapping, remapped when a record is past its end
+        mutable std::shared_ptr<const SegmentMapping> mapping;
+    };
+
+    std::string dir_;
+    mutable FileLock file_lock_;
+
+    std::unordered_map<std::string, Location> index_;
+    // (expires_at, key) for entries that expire
+    std::set<std::pair<int64_t, std::string>> expiry_;
+    std::map<uint32_t, Segment> segments_;
+
+    uint32_t active_segment_ = 0;
+    uint64_t next_sequence_ = 1;
+
+    CacheLimits limits_;
+    std::atomic<bool> is_compression_enabled_ = CacheLimits{}.compression;
+    uint64_t evictions_ = 0;
+    std::atomic<int64_t> expiry_grace_ = 0;
+
+    // The index file is behind the in-memory index
+    mutable bool is_dirty_ = false;
+
+    mutable std::shared_mutex mutex_;
+    mutable std::mutex mapping_mutex_;
+    mutable std::mutex access_mutex_;
+    std::mutex compaction_mutex_;
+
+    std::atomic<bool> is_maintaining_ = false;
+    std::jthread maintenance_thread_;
+
+    std::string GetSegmentPath(uint32_t id) const;
+    std::string GetIndexPath() const;
+
+    // Unless noted otherwise, the functions below are called with mutex_ held, the ones touching
+    // the files also hold file_lock_ (exclusively to truncate or write segments)
+
+    void Load();
+    bool LoadIndex(std::map<uint32_t, uint64_t>& covered);
+    bool WriteIndex() const;
+
+    // Syncs segments_ with the directory: replays new records, forgets removed or replaced segments.
+    // `covered` is the part of the segments the loaded index already has.
+    void CatchUp(bool can_truncate, const std::map<uint32_t, uint64_t>& covered = {});
+    uint64_t ReplaySegment(uint32_t id, uint64_t from, uint64_t to);
+    void ApplyRecord(const std::string& key, const Location& location);
+    void RemoveLiveBytes(const Location& location);
+    void EraseEntry(std::unordered_map<std::string, Location>::iterator it);
+    void EraseEntriesIf(const std::function<bool(const Location&)>& predicate);
+    bool HasExpired(int64_t now) const;
+
+    std::shared_ptr<const SegmentMapping> MapSegment(const Segment& segment, uint64_t min_size) const;
+
+    // Requires file_lock_ held exclusively and caught up, takes mutex_ itself
+    bool Append(const std::string& key, std::string_view value, int64_t written_at, int64_t expires_at);
+
+    bool OpenActiveSegment();
+    void CloseSegments();
+
+    void EvictOverBudget(const std::string& keep_key);
+
+    uint64_t GetGarbageBytes() const;
+};
+
+} // namespace WayHome
@@ -0,0 +1,229 @@
+#include "CacheWarmer.hpp"
+#include "Date.hpp"
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <fstream>
+#include <format>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+namespace WayHome {
+
+bool CacheWarmer::LoadSpecs(const std::string& filename) {
+    std::ifstream f(filename);
+
+    if (!f.good()) {
+        error_ = {"Unable to open " + filename, ErrorType::kEnvironmentError};
+        return false;
+    }
+
+    json specs_obj = json::parse(f, nullptr, false);
+
+    if (!specs_obj.is_array()) {
+        error_ = {"Warm-up specs must be a JSON array: " + filename, ErrorType::kParametersError};
+        return false;
+    }
+
+    for (size_t i = 0; i < specs_obj.size(); ++i) {
+        if (!AddSpec(specs_obj[i], i + 1)) {
+            return false;
+        }
+    }
+
+    // Specs may overlap, each search is made once
+    std::unordered_set<std::string> keys;
+    std::erase_if(queries_, [&keys](const ApiRouteParameters& parameters) {
+        return !keys.insert(MakeRoutesCacheKey(parameters)).second;
+    });
+
+    return true;
+}
+
+WarmReport CacheWarmer::Run(std::ostream& progress) {
+    WarmReport report;
+    report.queries = queries_.size();
+
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> requests = 0;
+
+    // Searches other runs made today are taken out of the budget
+    std::optional<uint32_t> remaining = GetApiQuota().GetRemaining(RequestClass::kSearch);
+    size_t max_requests = std::min<size_t>(max_requests_, remaining.value_or(max_requests_));
+
+    if (max_requests < max_requests_) {
+        progress << std::format("{} searches are left in today's API quota\n", max_requests);
+    }
+    std::mutex progress_mutex;
+    size_t done = 0;
+
+    auto work = [&] {
+        for (size_t i = next++; i < queries_.size(); i = next++) {
+            const ApiRouteParameters& parameters = queries_[i];
+
+            Error error;
+            QueryResult result = WarmQuery(parameters, requests, max_requests, error);
+
+            std::lock_guard lock{progress_mutex};
+            std::string status;
+
+            if (result == QueryResult::kFresh) {
+                ++report.fresh;
+                status = "fresh";
+            } else if (result == QueryResult::kFetched) {
+                ++report.fetched;
+                status = "fetched";
+            } else if (result == QueryResult::kSkipped) {
+                ++report.skipped;
+                status = "skipped, request budget is exhausted";
+            } else {
+                ++report.failed;
+                status = "failed: " + error.message;
+            }
+
+            progress << std::format("[{}/{}] {} -> {} {} {}: {}\n", ++done, report.queries,
+                parameters.from, parameters.to, parameters.date,
+                parameters.transport_type.empty() ? "all" : parameters.transport_type, status);
+        }
+    };
+
+    std::vector<std::jthread> workers;
+
+    for (size_t i = 0; i < std::min(jobs_, queries_.size()); ++i) {
+        workers.emplace_back(work);
+    }
+
+    workers.clear();
+
+    progress << std::format("Warm-up finished: {} fresh, {} fetched, {} failed, {} skipped\n",
+        report.fresh, report.fetched, report.failed, report.skipped);
+
+    return report;
+}
+
+const Error& CacheWarmer::GetError() const {
+    return error_;
+}
+
+bool CacheWarmer::HasError() const {
+    return error_.type != ErrorType::kOk;
+}
+
+bool CacheWarmer::AddSpec(const json& spec_obj, size_t number) {
+    auto fail = [this, number](const std::string& message) {
+        error_ = {std::format("Invalid warm-up spec #{}: {}", number, message), ErrorType::kParametersError};
+        return false;
+    };
+
+    if (!spec_obj.is_object()) {
+        return fail("must be an object");
+    }
+
+    ApiRouteParameters parameters{};
+
+    for (const char* name : {"from", "to"}) {
+        if (!spec_obj.contains(name) || !spec_obj[name].is_string()) {
+            return fail(std::format("\"{}\" must be a string", name));
+        }
+    }
+
+    parameters.from = spec_obj["from"];
+    parameters.to = spec_obj["to"];
+    parameters.max_transfers = 1;
+
+    if (spec_obj.contains("transport")) {
+        if (!spec_obj["transport"].is_string()) {
+            return fail("\"transport\" must be a string");
+        }
+
+        parameters.transport_type = spec_obj["transport"];
+    }
+
+    if (spec_obj.contains("transfers")) {
+        if (!spec_obj["transfers"].is_number_unsigned()) {
+            return fail("\"transfers\" must be a non-negative number");
+        }
+
+        parameters.max_transfers = spec_obj["transfers"];
+    }
+
+    std::string date_from = spec_obj.value("date_from", spec_obj.value("date", std::string{}));
+    std::string date_to = spec_obj.value("date_to", date_from);
+
+    std::optional<std::chrono::sys_days> first_day = ParseDate(date_from);
+    std::optional<std::chrono::sys_days> last_day = ParseDate(date_to);
+
+    if (!first_day.has_value() || !last_day.has_value()) {
+        return fail("\"date\" or \"date_from\" and \"date_to\" must be dates in YYYY-MM-DD format");
+    }
+
+    std::optional<std::vector<std::string>> dates = ExpandDateRange(first_day.value(), last_day.value(), kWarmMaxDaysPerSpec);
+
+    if (!dates.has_value()) {
+        return fail(std::format("the date range must be ordered and at most {} days long", kWarmMaxDaysPerSpec));
+    }
+
+    for (const std::string& date : dates.value()) {
+        parameters.date = date;
+        queries_.push_back(CanonicalizeRouteParameters(parameters));
+    }
+
+    return true;
+}
+
+CacheWarmer::QueryResult CacheWarmer::WarmQuery(const ApiRouteParameters& parameters,
+                                                std::atomic<size_t>& requests,
+                                                size_t max_requests,
+                                                Error& error) const {
+    WayHome wayhome{parameters, options_};
+
+    if (wayhome.HasError()) {
+        error = wayhome.GetError();
+        return QueryResult::kFailed;
+    }
+
+    CacheState state = wayhome.GetCacheState();
+
+    if (state == CacheState::kFresh) {
+        return QueryResult::kFresh;
+    }
+
+    if (state == CacheState::kFailed) {
+        error = {"failed recently, use --retry-failed to ask the API again", ErrorType::kParametersError};
+        return QueryResult::kFailed;
+    }
+
+    // Counted per page request, a query may send up to kMaxRoutePages of them
+    bool is_refused = false;
+
+    wayhome.SetRequestBudget([&requests, max_requests, &is_refused] {
+        size_t sent = requests.load();
+
+        do {
+            if (sent >= max_requests) {
+                is_refused = true;
+                return false;
+            }
+        } while (!requests.compare_exchange_weak(sent, sent + 1));
+
+        return true;
+    });
+
+    wayhome.UpdateRoutesWithAPI();
+
+    if (wayhome.HasError() && is_refused) {
+        return QueryResult::kSkipped;
+    }
+
+    if (wayhome.HasError()) {
+        error = wayhome.GetError();
+        return QueryResult::kFailed;
+    }
+
+    return QueryResult::kFetched;
+}
+
+} // namespace WayHome
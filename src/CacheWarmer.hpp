@@ -0,0 +1,71 @@
+#pragma once
+
+#include "WayHome.hpp"
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <atomic>
+#include <cstddef>
+
+namespace WayHome {
+
+const size_t kWarmDefaultJobs = 4;
+// Searches a day on the free plan of the API
+const size_t kWarmDefaultMaxRequests = 500;
+const size_t kWarmMaxDaysPerSpec = 366;
+
+struct WarmReport {
+    size_t queries = 0;
+    size_t fresh = 0;
+    size_t fetched = 0;
+    size_t failed = 0;
+    // Not fetched because the request budget ran out
+    size_t skipped = 0;
+};
+
+// Fills the route cache for a list of known queries ahead of time.
+// Specs are read from a JSON array of objects:
+//   {"from": "c213", "to": "c2", "date_from": "2025-06-01", "date_to": "2025-06-07",
+//    "transport": "train", "transfers": 1}
+// "date" may be given instead of the range, "transport" and "transfers" are optional.
+// Queries are run by `jobs` threads, fresh entries and remembered failures are skipped,
+// at most `max_requests` search requests (one per page of routes) are sent to the API,
+// fewer if less are left in today's quota.
+class CacheWarmer {
+public:
+    CacheWarmer(CacheOptions options, size_t jobs, size_t max_requests)
+        : options_(options)
+        , jobs_(jobs == 0 ? 1 : jobs)
+        , max_requests_(max_requests) {}
+
+    bool LoadSpecs(const std::string& filename);
+    WarmReport Run(std::ostream& progress);
+
+    const Error& GetError() const;
+    bool HasError() const;
+
+private:
+    enum class QueryResult {
+        kFresh,
+        kFetched,
+        kFailed,
+        kSkipped
+    };
+
+    CacheOptions options_;
+    size_t jobs_;
+    size_t max_requests_;
+
+    std::vector<ApiRouteParameters> queries_;
+
+    Error error_;
+
+    bool AddSpec(const json& spec_obj, size_t number);
+    QueryResult WarmQuery(const ApiRouteParameters& parameters,
+                          std::atomic<size_t>& requests,
+                          size_t max_requests,
+                          Error& error) const;
+};
+
+} // namespace WayHome
@@ -0,0 +1,39 @@
+#include "Checksum.hpp"
+
+#include <array>
+
+namespace WayHome {
+
+namespace {
+
+constexpr std::array<uint32_t, 256> MakeCrc32Table() {
+    std::array<uint32_t, 256> table{};
+
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t value = i;
+
+        for (int bit = 0; bit < 8; ++bit) {
+            value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+        }
+
+        table[i] = value;
+    }
+
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> kCrc32Table = MakeCrc32Table();
+
+} // namespace
+
+uint32_t Crc32(std::string_view data, uint32_t crc) {
+    crc = ~crc;
+
+    for (char ch : data) {
+        crc = kCrc32Table[(crc ^ static_cast<uint8_t>(ch)) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+} // namespace WayHome
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string_view>
+#include <cstdint>
+
+namespace WayHome {
+
+// CRC-32 (IEEE 802.3), `crc` allows to continue a previous computation
+uint32_t Crc32(std::string_view data, uint32_t crc = 0);
+
+} // namespace WayHome
@@ -1,39 +1,70 @@
 #include "CodeSearcher.hpp"
+#include "CacheKey.hpp"
+#include "Metrics.hpp"
 
-#include <filesystem>
-#include <fstream>
+#include <format>
 
 namespace WayHome {
 
 std::expected<std::string, Error> CodeSearcher::FindCode(const std::string& input) const {
-    std::optional<std::string> in_cache = TryFindingInCache(input);
+    std::optional<std::string> in_directory = GetStationDirectory().FindCode(input);
+
+    if (in_directory.has_value()) {
+        return in_directory.value();
+    }
+
+    std::optional<std::string> in_cache = GetStationIndex().Find(input);
+    GetMetrics().Increment(in_cache.has_value() ? Counter::kCacheHits : Counter::kCacheMisses);
 
     if (in_cache.has_value()) {
         return in_cache.value();
     }
 
+    std::optional<std::string> folded_match = GetStationMatcher().FindCode(input);
+
+    if (folded_match.has_value()) {
+        return folded_match.value();
+    }
+
+    std::string failure_filename = MakeFailureCacheKey(input);
+
+    if (!is_failure_cache_bypassed_) {
+        std::optional<Error> failure = cache_handler.LoadFailure(failure_filename);
+
+        if (failure.has_value()) {
+            failure->message += " (remembered, use --retry-failed to ask the API again)";
+            return std::unexpected{failure.value()};
+        }
+    }
+
     std::expected<std::string, Error> call_result = CallApi(input);
 
     if (!call_result.has_value()) {
-        return std::unexpected{call_result.error()};
-    }
+        // Unknown names stay unknown for a while, network and API errors are not remembered
+        if (call_result.error().type != ErrorType::kParametersError) {
+            return std::unexpected{call_result.error()};
+        }
 
-    SaveToCache(input, call_result.value());
-    return call_result.value();
-}
+        Error error = call_result.error();
+        std::vector<StationCandidate> candidates = Suggest(input, kCodesSuggestionsInError);
 
-bool CodeSearcher::DoesCacheExist() const {
-    return std::filesystem::exists(kCodesFilename);
-}
+        if (!candidates.empty()) {
+            error.message += ". Did you mean:";
 
-std::optional<std::string> CodeSearcher::TryFindingInCache(const std::string& input) const {
-    json cache_obj;
+            for (const StationCandidate& candidate : candidates) {
+                error.message += std::format(" \"{}\" ({})", candidate.point.title, candidate.point.code);
+            }
+        }
+
+        if (failed_ttl_seconds_ != 0) {
+            cache_handler.RememberFailure(error, failure_filename, failed_ttl_seconds_);
+        }
 
-    if (!cache_handler.LoadCache(cache_obj, kCodesFilename) || !cache_obj.contains(input)) {
-        return std::nullopt;
+        return std::unexpected{error};
     }
 
-    return cache_obj[input];
+    GetStationIndex().Add(input, call_result.value());
+    return call_result.value();
 }
 
 std::expected<std::string, Error> CodeSearcher::CallApi(const std::string& input) const {
@@ -56,7 +87,7 @@ std::expected<std::string, Error> CodeSearcher::CallApi(const std::string& input
             return std::unexpected{Error{"API suggestion doesn't have \"point_key\" field", ErrorType::kApiError}};
         }
 
-        if (suggestion["title"] == input) {
+        if (suggestion["title"].is_string() && FoldCase(suggestion["title"].get<std::string>()) == FoldCase(input)) {
             return suggestion["point_key"];
         }
     }
@@ -64,15 +95,43 @@ std::expected<std::string, Error> CodeSearcher::CallApi(const std::string& input
     return std::unexpected{Error{"Couldn't find the name", ErrorType::kParametersError}};
 }
 
-bool CodeSearcher::SaveToCache(const std::string& name, const std::string& code) const {
-    json cache_obj;
+void CodeSearcher::SetFailureCaching(uint32_t ttl_seconds, bool is_bypassed) {
+    failed_ttl_seconds_ = ttl_seconds;
+    is_failure_cache_bypassed_ = is_bypassed;
+}
 
-    if (!std::filesystem::exists(kCodesFilename) || cache_handler.LoadCache(cache_obj, kCodesFilename)) {
-        cache_obj[name] = code;
-        return cache_handler.UpdateCache(cache_obj, kCodesFilename);
-    }
+StationIndex& CodeSearcher::GetStationIndex() {
+    static StationIndex station_index{kCodesCacheDir};
+    return station_index;
+}
+
+std::vector<StationCandidate> CodeSearcher::Suggest(const std::string& input, size_t limit) const {
+    return GetStationMatcher().Match(input, limit);
+}
+
+const StationMatcher& CodeSearcher::GetStationMatcher() {
+    static const StationMatcher station_matcher = [] {
+        StationMatcher matcher;
+        GetStationDirectory().ForEachPoint([&matcher](const RoutePoint& point) {
+            matcher.Add(point);
+        });
+        matcher.Build();
+
+        return matcher;
+    }();
+
+    return station_matcher;
+}
+
+const StationDirectory& CodeSearcher::GetStationDirectory() {
+    static const StationDirectory station_directory = [] {
+        StationDirectory directory;
+        directory.Open(kStationDirectoryFilename);
+
+        return directory;
+    }();
 
-    return false;
+    return station_directory;
 }
 
 } // namespace WayHome
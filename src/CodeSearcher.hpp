@@ -2,31 +2,51 @@
 
 #include "ApiHandler.hpp"
 #include "CacheHandler.hpp"
+#include "StationIndex.hpp"
+#include "StationDirectory.hpp"
+#include "StationMatcher.hpp"
 
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 
 #include <expected>
 #include <optional>
+#include <vector>
 
 namespace WayHome {
 
-const std::string kCodesFilename = "wayhome_codes.json";
+const std::string kCodesCacheDir = "wayhome_codes";
 
+const uint32_t kCodesFailedSecondsTTL = 5 * 60;
+const size_t kCodesSuggestionsInError = 3;
+
+// Names are looked up in the offline station directory, then among the names resolved before,
+// then in the directory again ignoring case, and only then with the suggests API
 class CodeSearcher {
 public:
     std::expected<std::string, Error> FindCode(const std::string& input) const;
+    // Titles of the offline station directory resembling the input, best first
+    std::vector<StationCandidate> Suggest(const std::string& input, size_t limit = kStationMatchDefaultLimit) const;
+
+    // Names that weren't found are remembered for `ttl_seconds` (0 to not remember them)
+    // and reported without asking the API again, unless `is_bypassed`
+    void SetFailureCaching(uint32_t ttl_seconds, bool is_bypassed);
 
 private:
     ApiHandler api_handler;
-    CacheHandler cache_handler;
+    CacheHandler cache_handler{kCodesCacheDir, 0};
 
-    bool DoesCacheExist() const;
+    uint32_t failed_ttl_seconds_ = kCodesFailedSecondsTTL;
+    bool is_failure_cache_bypassed_ = false;
 
-    std::optional<std::string> TryFindingInCache(const std::string& input) const;
     std::expected<std::string, Error> CallApi(const std::string& input) const;
 
-    bool SaveToCache(const std::string& name, const std::string& code) const;
+    // Shared by all searchers of the process
+    static StationIndex& GetStationIndex();
+    // Opened once, empty if the directory wasn't imported
+    static const StationDirectory& GetStationDirectory();
+    // Built from the directory on the first use
+    static const StationMatcher& GetStationMatcher();
 };
     
 } // namespace WayHome
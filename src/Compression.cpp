@@ -0,0 +1,36 @@
+#include "Compression.hpp"
+
+#include <zlib.h>
+
+namespace WayHome {
+
+std::optional<std::string> Compress(std::string_view data) {
+    uLongf size = compressBound(data.size());
+    std::string compressed(size, '\0');
+
+    int result = compress2(reinterpret_cast<Bytef*>(compressed.data()), &size,
+        reinterpret_cast<const Bytef*>(data.data()), data.size(), Z_DEFAULT_COMPRESSION);
+
+    if (result != Z_OK) {
+        return std::nullopt;
+    }
+
+    compressed.resize(size);
+    return compressed;
+}
+
+std::optional<std::string> Decompress(std::string_view data, size_t raw_size) {
+    uLongf size = raw_size;
+    std::string decompressed(raw_size, '\0');
+
+    int result = uncompress(reinterpret_cast<Bytef*>(decompressed.data()), &size,
+        reinterpret_cast<const Bytef*>(data.data()), data.size());
+
+    if (result != Z_OK || size != raw_size) {
+        return std::nullopt;
+    }
+
+    return decompressed;
+}
+
+} // namespace WayHome
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <optional>
+
+namespace WayHome {
+
+// zlib (deflate) streams
+std::optional<std::string> Compress(std::string_view data);
+std::optional<std::string> Decompress(std::string_view data, size_t raw_size);
+
+} // namespace WayHome
@@ -0,0 +1,60 @@
+#include "Date.hpp"
+
+#include <charconv>
+#include <format>
+
+namespace WayHome {
+
+std::optional<std::chrono::sys_days> ParseDate(const std::string& date) {
+    int year;
+    unsigned month;
+    unsigned day;
+
+    if (date.size() != 10 || date[4] != '-' || date[7] != '-'
+    || std::from_chars(date.data(), date.data() + 4, year).ptr != date.data() + 4
+    || std::from_chars(date.data() + 5, date.data() + 7, month).ptr != date.data() + 7
+    || std::from_chars(date.data() + 8, date.data() + 10, day).ptr != date.data() + 10) {
+        return std::nullopt;
+    }
+
+    std::chrono::year_month_day ymd{std::chrono::year{year}, std::chrono::month{month}, std::chrono::day{day}};
+
+    if (!ymd.ok()) {
+        return std::nullopt;
+    }
+
+    return std::chrono::sys_days{ymd};
+}
+
+std::chrono::sys_days GetApiDay(std::chrono::system_clock::time_point now) {
+    return std::chrono::floor<std::chrono::days>(now + kApiTimeZoneOffset);
+}
+
+std::chrono::system_clock::time_point GetApiDayStart(std::chrono::sys_days day) {
+    return day - kApiTimeZoneOffset;
+}
+
+std::string FormatDate(std::chrono::sys_days day) {
+    std::chrono::year_month_day ymd{day};
+
+    return std::format("{:04}-{:02}-{:02}",
+        static_cast<int>(ymd.year()), static_cast<unsigned>(ymd.month()), static_cast<unsigned>(ymd.day()));
+}
+
+std::optional<std::vector<std::string>> ExpandDateRange(std::chrono::sys_days first,
+                                                        std::chrono::sys_days last,
+                                                        size_t max_days) {
+    if (last < first || (last - first).count() >= static_cast<int64_t>(max_days)) {
+        return std::nullopt;
+    }
+
+    std::vector<std::string> dates;
+
+    for (std::chrono::sys_days day = first; day <= last; day += std::chrono::days{1}) {
+        dates.push_back(FormatDate(day));
+    }
+
+    return dates;
+}
+
+} // namespace WayHome
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <optional>
+#include <vector>
+#include <chrono>
+#include <cstddef>
+
+namespace WayHome {
+
+// Dates of the API and its daily quota are days of Moscow time, which has no daylight saving
+const std::chrono::hours kApiTimeZoneOffset{3};
+
+// The day of Moscow time `now` falls on
+std::chrono::sys_days GetApiDay(std::chrono::system_clock::time_point now = std::chrono::system_clock::now());
+// Moment the day of Moscow time starts at
+std::chrono::system_clock::time_point GetApiDayStart(std::chrono::sys_days day);
+
+// Dates of departure in the YYYY-MM-DD format used by the API
+std::optional<std::chrono::sys_days> ParseDate(const std::string& date);
+std::string FormatDate(std::chrono::sys_days day);
+
+// Dates from `first` to `last` inclusive, std::nullopt if `last` is before `first` or there are more than `max_days`
+std::optional<std::vector<std::string>> ExpandDateRange(std::chrono::sys_days first,
+                                                        std::chrono::sys_days last,
+                                                        size_t max_days);
+
+} // namespace WayHome
@@ -0,0 +1,54 @@
+#include "FileLock.hpp"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+namespace WayHome {
+
+FileLock::~FileLock() {
+    if (fd_ != -1) {
+        ::close(fd_);
+    }
+}
+
+void FileLock::lock() {
+    Acquire(LOCK_EX);
+}
+
+void FileLock::unlock() {
+    Release();
+}
+
+void FileLock::lock_shared() {
+    Acquire(LOCK_SH);
+}
+
+void FileLock::unlock_shared() {
+    Release();
+}
+
+void FileLock::Acquire(int operation) {
+    mutex_.lock();
+
+    // The directory of the file may appear later, so opening is retried on every lock
+    if (fd_ == -1) {
+        fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    }
+
+    if (fd_ != -1) {
+        while (::flock(fd_, operation) == -1 && errno == EINTR) {}
+    }
+}
+
+void FileLock::Release() {
+    if (fd_ != -1) {
+        ::flock(fd_, LOCK_UN);
+    }
+
+    mutex_.unlock();
+}
+
+} // namespace WayHome
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+
+namespace WayHome {
+
+// Advisory flock(2) lock on a file, shared with other processes using the same file.
+// Meets the Lockable and SharedLockable requirements, so std::unique_lock and std::shared_lock work with it.
+// flock modes of one descriptor don't nest, so threads of the process take the lock one at a time
+// in both modes. If the file can't be opened, only the threads of the process are excluded.
+class FileLock {
+public:
+    explicit FileLock(std::string path) : path_(std::move(path)) {}
+    ~FileLock();
+
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+
+    void lock();
+    void unlock();
+
+    void lock_shared();
+    void unlock_shared();
+
+private:
+    std::string path_;
+    int fd_ = -1;
+    std::mutex mutex_;
+
+    void Acquire(int operation);
+    void Release();
+};
+
+} // namespace WayHome
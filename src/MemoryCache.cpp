@@ -0,0 +1,89 @@
+#include "MemoryCache.hpp"
+#include "Metrics.hpp"
+
+namespace WayHome {
+
+bool MemoryCache::Get(RoutesHandler& to, const std::string& key) {
+    std::lock_guard lock{mutex_};
+
+    auto it = index_.find(key);
+
+    if (it == index_.end() || Clock::now() >= it->second->expires_at) {
+        if (it != index_.end()) {
+            EraseEntry(it->second);
+        }
+
+        GetMetrics().Increment(Counter::kMemoryCacheMisses);
+        return false;
+    }
+
+    GetMetrics().Increment(Counter::kMemoryCacheHits);
+    entries_.splice(entries_.begin(), entries_, it->second);
+    to = it->second->routes;
+
+    return true;
+}
+
+void MemoryCache::Put(const std::string& key, const RoutesHandler& routes, Clock::time_point expires_at) {
+    std::lock_guard lock{mutex_};
+
+    auto it = index_.find(key);
+
+    if (it != index_.end()) {
+        EraseEntry(it->second);
+    }
+
+    size_t bytes = key.size() + routes.GetApproximateSize();
+
+    if (bytes > max_bytes_ || max_entries_ == 0 || Clock::now() >= expires_at) {
+        return;
+    }
+
+    entries_.push_front(Entry{key, routes, bytes, expires_at});
+    index_[key] = entries_.begin();
+    bytes_ += bytes;
+
+    EvictOverflow();
+}
+
+void MemoryCache::Erase(const std::string& key) {
+    std::lock_guard lock{mutex_};
+
+    auto it = index_.find(key);
+
+    if (it != index_.end()) {
+        EraseEntry(it->second);
+    }
+}
+
+void MemoryCache::Clear() {
+    std::lock_guard lock{mutex_};
+
+    entries_.clear();
+    index_.clear();
+    bytes_ = 0;
+}
+
+size_t MemoryCache::GetSize() const {
+    std::lock_guard lock{mutex_};
+    return entries_.size();
+}
+
+size_t MemoryCache::GetBytes() const {
+    std::lock_guard lock{mutex_};
+    return bytes_;
+}
+
+void MemoryCache::EraseEntry(std::list<Entry>::iterator it) {
+    bytes_ -= it->bytes;
+    index_.erase(it->key);
+    entries_.erase(it);
+}
+
+void MemoryCache::EvictOverflow() {
+    while (!entries_.empty() && (entries_.size() > max_entries_ || bytes_ > max_bytes_)) {
+        EraseEntry(std::prev(entries_.end()));
+    }
+}
+
+} // namespace WayHome
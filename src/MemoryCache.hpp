@@ -0,0 +1,55 @@
+#pragma once
+
+#include "RoutesHandler.hpp"
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <chrono>
+#include <mutex>
+#include <cstddef>
+
+namespace WayHome {
+
+// In-process LRU tier in front of CacheHandler's file cache.
+// Holds already built routes, so a hit skips disk I/O and JSON parsing.
+class MemoryCache {
+public:
+    using Clock = std::chrono::system_clock;
+
+    MemoryCache(size_t max_entries, size_t max_bytes)
+        : max_entries_(max_entries)
+        , max_bytes_(max_bytes) {}
+
+    bool Get(RoutesHandler& to, const std::string& key);
+    void Put(const std::string& key, const RoutesHandler& routes, Clock::time_point expires_at);
+
+    void Erase(const std::string& key);
+    void Clear();
+
+    size_t GetSize() const;
+    size_t GetBytes() const;
+
+private:
+    struct Entry {
+        std::string key;
+        RoutesHandler routes;
+        size_t bytes;
+        Clock::time_point expires_at;
+    };
+
+    size_t max_entries_;
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+
+    // Most recently used entries are at the front
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+
+    mutable std::mutex mutex_;
+
+    void EraseEntry(std::list<Entry>::iterator it);
+    void EvictOverflow();
+};
+
+} // namespace WayHome
@@ -0,0 +1,189 @@
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <fstream>
+#include <filesystem>
+
+namespace WayHome {
+
+namespace {
+
+const std::array<std::string_view, static_cast<size_t>(Counter::kCount)> kCounterNames = {
+    "cache_hits",
+    "cache_misses",
+    "cache_expired",
+    "cache_negative_hits",
+    "memory_cache_hits",
+    "memory_cache_misses",
+    "cache_bytes_read",
+    "cache_bytes_written",
+    "api_requests",
+    "api_errors",
+    "api_bytes_received",
+    "api_bytes_transferred",
+    "api_connections_opened",
+    "api_connections_reused",
+    "api_retries",
+    "api_circuit_rejected",
+    "api_requests_coalesced"
+};
+
+const std::array<std::string_view, static_cast<size_t>(Stage::kCount)> kStageNames = {
+    "routes_request",
+    "suggests_request",
+    "build_from_json",
+    "build_from_binary"
+};
+
+uint64_t GetBucketBound(size_t bucket) {
+    return uint64_t{1} << bucket;
+}
+
+} // namespace
+
+void Histogram::Observe(std::chrono::nanoseconds duration) {
+    uint64_t microseconds = std::max<int64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(duration).count(), 0);
+
+    size_t bucket = std::min<size_t>(std::bit_width(microseconds), kBuckets - 1);
+
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_ns_.fetch_add(std::max<int64_t>(duration.count(), 0), std::memory_order_relaxed);
+}
+
+uint64_t Histogram::GetCount() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+std::chrono::microseconds Histogram::GetQuantile(double quantile) const {
+    uint64_t count = GetCount();
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+
+        if (count != 0 && seen >= quantile * count) {
+            return std::chrono::microseconds(GetBucketBound(i));
+        }
+    }
+
+    return std::chrono::microseconds{0};
+}
+
+json Histogram::ToJson() const {
+    json buckets_obj = json::object();
+
+    for (size_t i = 0; i < kBuckets; ++i) {
+        uint64_t bucket_count = buckets_[i].load(std::memory_order_relaxed);
+
+        if (bucket_count != 0) {
+            buckets_obj[std::to_string(GetBucketBound(i))] = bucket_count;
+        }
+    }
+
+    return {
+        {"count", GetCount()},
+        {"sum_ms", sum_ns_.load(std::memory_order_relaxed) / 1e6},
+        {"p50_us", GetQuantile(0.5).count()},
+        {"p99_us", GetQuantile(0.99).count()},
+        {"buckets_us", std::move(buckets_obj)}
+    };
+}
+
+void Histogram::DumpPrometheus(std::ostream& stream, std::string_view name) const {
+    stream << std::format("# TYPE wayhome_{}_seconds histogram\n", name);
+
+    uint64_t cumulative = 0;
+
+    // The last bucket is open-ended, it's reported as +Inf only
+    for (size_t i = 0; i + 1 < kBuckets; ++i) {
+        cumulative += buckets_[i].load(std::memory_order_relaxed);
+        stream << std::format("wayhome_{}_seconds_bucket{{le=\"{}\"}} {}\n", name, GetBucketBound(i) / 1e6, cumulative);
+    }
+
+    stream << std::format("wayhome_{}_seconds_bucket{{le=\"+Inf\"}} {}\n", name, GetCount());
+    stream << std::format("wayhome_{}_seconds_sum {}\n", name, sum_ns_.load(std::memory_order_relaxed) / 1e9);
+    stream << std::format("wayhome_{}_seconds_count {}\n", name, GetCount());
+}
+
+void Metrics::Increment(Counter counter, uint64_t value) {
+    counters_[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t Metrics::GetCount(Counter counter) const {
+    return counters_[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+void Metrics::Observe(Stage stage, std::chrono::nanoseconds duration) {
+    histograms_[static_cast<size_t>(stage)].Observe(duration);
+}
+
+const Histogram& Metrics::GetHistogram(Stage stage) const {
+    return histograms_[static_cast<size_t>(stage)];
+}
+
+json Metrics::ToJson() const {
+    json counters_obj = json::object();
+    json latencies_obj = json::object();
+
+    for (size_t i = 0; i < kCounterNames.size(); ++i) {
+        counters_obj[kCounterNames[i]] = GetCount(static_cast<Counter>(i));
+    }
+
+    for (size_t i = 0; i < kStageNames.size(); ++i) {
+        latencies_obj[kStageNames[i]] = histograms_[i].ToJson();
+    }
+
+    return {
+        {"counters", std::move(counters_obj)},
+        {"latencies", std::move(latencies_obj)}
+    };
+}
+
+void Metrics::DumpPrometheus(std::ostream& stream) const {
+    for (size_t i = 0; i < kCounterNames.size(); ++i) {
+        stream << std::format("# TYPE wayhome_{}_total counter\n", kCounterNames[i]);
+        stream << std::format("wayhome_{}_total {}\n", kCounterNames[i], GetCount(static_cast<Counter>(i)));
+    }
+
+    for (size_t i = 0; i < kStageNames.size(); ++i) {
+        histograms_[i].DumpPrometheus(stream, kStageNames[i]);
+    }
+}
+
+bool Metrics::WritePrometheus(const std::string& path) const {
+    std::string temp_path = path + ".tmp";
+
+    {
+        std::ofstream file{temp_path};
+
+        if (!file.is_open()) {
+            return false;
+        }
+
+        DumpPrometheus(file);
+
+        if (!file.flush()) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+
+    return !ec;
+}
+
+Metrics& GetMetrics() {
+    static Metrics metrics;
+    return metrics;
+}
+
+ScopedTimer::~ScopedTimer() {
+    GetMetrics().Observe(stage_, std::chrono::steady_clock::now() - start_);
+}
+
+} // namespace WayHome
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+namespace WayHome {
+
+const std::chrono::seconds kMetricsWriteInterval{5};
+
+enum class Counter {
+    kCacheHits,
+    kCacheMisses,
+    kCacheExpired,
+    kCacheNegativeHits,
+    kMemoryCacheHits,
+    kMemoryCacheMisses,
+    kCacheBytesRead,
+    kCacheBytesWritten,
+    kApiRequests,
+    kApiErrors,
+    kApiBytesReceived,
+    kApiBytesTransferred,
+    kApiConnectionsOpened,
+    kApiConnectionsReused,
+    kApiRetries,
+    kApiCircuitRejected,
+    kApiRequestsCoalesced,
+    kCount
+};
+
+enum class Stage {
+    kRoutesRequest,
+    kSuggestsRequest,
+    kBuildFromJson,
+    kBuildFromBinary,
+    kCount
+};
+
+// Durations counted in power-of-two buckets: bucket i holds the ones shorter than 2^i microseconds,
+// the last bucket also holds everything longer
+class Histogram {
+public:
+    static const size_t kBuckets = 32;
+
+    void Observe(std::chrono::nanoseconds duration);
+
+    uint64_t GetCount() const;
+    // Upper bound of the bucket the quantile falls into
+    std::chrono::microseconds GetQuantile(double quantile) const;
+
+    json ToJson() const;
+    void DumpPrometheus(std::ostream& stream, std::string_view name) const;
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<uint64_t> sum_ns_ = 0;
+};
+
+// Counters and latency histograms of the process, updated without locks
+class Metrics {
+public:
+    void Increment(Counter counter, uint64_t value = 1);
+    uint64_t GetCount(Counter counter) const;
+
+    void Observe(Stage stage, std::chrono::nanoseconds duration);
+    const Histogram& GetHistogram(Stage stage) const;
+
+    json ToJson() const;
+    // Prometheus text exposition format
+    void DumpPrometheus(std::ostream& stream) const;
+    // Replaces the file at once, so a scraper never sees it half written
+    bool WritePrometheus(const std::string& path) const;
+
+private:
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::kCount)> counters_{};
+    std::array<Histogram, static_cast<size_t>(Stage::kCount)> histograms_;
+};
+
+Metrics& GetMetrics();
+
+// Observes the time from its construction to its destruction
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Stage stage)
+        : stage_(stage)
+        , start_(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace WayHome
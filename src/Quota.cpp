@@ -0,0 +1,294 @@
+#include "Quota.hpp"
+#include "Date.hpp"
+
+#include <fstream>
+#include <filesystem>
+#include <format>
+#include <algorithm>
+#include <thread>
+#include <condition_variable>
+#include <shared_mutex>
+
+#include <unistd.h>
+
+namespace WayHome {
+
+namespace {
+
+const std::array<std::string_view, static_cast<size_t>(RequestClass::kCount)> kRequestClassNames = {
+    "search",
+    "suggests"
+};
+
+bool ParseRequestClassLimits(const json& obj, RequestClassLimits& limits) {
+    if (!obj.is_object()) {
+        return false;
+    }
+
+    if (obj.contains("per_day")) {
+        if (!obj["per_day"].is_number_unsigned()) {
+            return false;
+        }
+
+        limits.per_day = obj["per_day"];
+    }
+
+    if (obj.contains("per_second")) {
+        if (!obj["per_second"].is_number() || obj["per_second"] < 0) {
+            return false;
+        }
+
+        limits.per_second = obj["per_second"];
+    }
+
+    if (obj.contains("burst")) {
+        if (!obj["burst"].is_number_unsigned() || obj["burst"] == 0) {
+            return false;
+        }
+
+        limits.burst = obj["burst"];
+    }
+
+    return true;
+}
+
+} // namespace
+
+const RequestClassLimits& QuotaLimits::Get(RequestClass request_class) const {
+    return request_class == RequestClass::kSearch ? search : suggests;
+}
+
+bool ParseQuotaLimits(const json& obj, QuotaLimits& limits) {
+    if (!obj.is_object()) {
+        return false;
+    }
+
+    if (obj.contains("search") && !ParseRequestClassLimits(obj["search"], limits.search)) {
+        return false;
+    }
+
+    if (obj.contains("suggests") && !ParseRequestClassLimits(obj["suggests"], limits.suggests)) {
+        return false;
+    }
+
+    return true;
+}
+
+void TokenBucket::Configure(double rate, uint32_t burst) {
+    std::lock_guard lock{mutex_};
+
+    Refill(Clock::now());
+    rate_ = rate;
+    burst_ = burst;
+    tokens_ = std::min(tokens_, burst_);
+}
+
+bool TokenBucket::Acquire(std::stop_token stop_token, std::chrono::milliseconds max_wait) {
+    std::chrono::duration<double> wait{0};
+
+    {
+        std::lock_guard lock{mutex_};
+
+        if (rate_ == 0) {
+            return true;
+        }
+
+        Refill(Clock::now());
+
+        // The token is promised right away, the ones arriving later wait for the next
+        if (tokens_ < 1) {
+            wait = std::chrono::duration<double>{(1 - tokens_) / rate_};
+
+            if (wait > max_wait) {
+                return false;
+            }
+        }
+
+        tokens_ -= 1;
+    }
+
+    if (wait.count() == 0) {
+        return true;
+    }
+
+    std::mutex mutex;
+    std::condition_variable_any wakeup;
+    std::unique_lock lock{mutex};
+
+    if (wakeup.wait_for(lock, stop_token, std::chrono::duration_cast<Clock::duration>(wait), [] { return false; })
+    || stop_token.stop_requested()) {
+        std::lock_guard bucket_lock{mutex_};
+        tokens_ += 1;
+
+        return false;
+    }
+
+    return true;
+}
+
+void TokenBucket::Refill(Clock::time_point now) {
+    tokens_ = std::min(burst_, tokens_ + std::chrono::duration<double>{now - updated_at_}.count() * rate_);
+    updated_at_ = now;
+}
+
+QuotaLedger::QuotaLedger(std::string dir)
+    : dir_(std::move(dir))
+    , file_lock_(dir_ + "/" + kQuotaLockFilename) {}
+
+bool QuotaLedger::TryReserve(RequestClass request_class, uint32_t limit) {
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+
+    std::unique_lock lock{file_lock_};
+    Usage usage = Read();
+    uint32_t& used = usage.used[static_cast<size_t>(request_class)];
+
+    if (limit != 0 && used >= limit) {
+        return false;
+    }
+
+    ++used;
+
+    // A request that can't be counted is let through, the ledger is only an estimate of the API's count
+    Write(usage);
+    return true;
+}
+
+uint32_t QuotaLedger::GetUsed(RequestClass request_class) const {
+    std::shared_lock lock{file_lock_};
+    return Read().used[static_cast<size_t>(request_class)];
+}
+
+std::string QuotaLedger::GetToday() {
+    // The API counts requests per day of Moscow time
+    return FormatDate(GetApiDay());
+}
+
+QuotaLedger::Usage QuotaLedger::Read() const {
+    Usage usage;
+    usage.day = GetToday();
+
+    std::ifstream file{dir_ + "/" + kQuotaLedgerFilename};
+
+    if (!file.good()) {
+        return usage;
+    }
+
+    json ledger_obj = json::parse(file, nullptr, false);
+
+    // Requests of the previous days don't count
+    if (!ledger_obj.is_object() || ledger_obj.value("day", std::string{}) != usage.day) {
+        return usage;
+    }
+
+    for (size_t i = 0; i < kRequestClassNames.size(); ++i) {
+        std::string name{kRequestClassNames[i]};
+
+        if (ledger_obj.contains(name) && ledger_obj[name].is_number_unsigned()) {
+            usage.used[i] = ledger_obj[name];
+        }
+    }
+
+    return usage;
+}
+
+bool QuotaLedger::Write(const Usage& usage) const {
+    json ledger_obj{{"day", usage.day}};
+
+    for (size_t i = 0; i < kRequestClassNames.size(); ++i) {
+        ledger_obj[std::string{kRequestClassNames[i]}] = usage.used[i];
+    }
+
+    std::string path = dir_ + "/" + kQuotaLedgerFilename;
+    std::string temp_path = std::format("{}.{}.tmp", path, ::getpid());
+
+    {
+        std::ofstream file{temp_path};
+
+        if (!(file << ledger_obj) || !file.flush()) {
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+
+    return !ec;
+}
+
+ApiQuota::ApiQuota() {
+    SetLimits(QuotaLimits{});
+}
+
+void ApiQuota::SetLimits(const QuotaLimits& limits) {
+    std::lock_guard lock{mutex_};
+    limits_ = limits;
+
+    for (size_t i = 0; i < buckets_.size(); ++i) {
+        const RequestClassLimits& class_limits = limits_.Get(static_cast<RequestClass>(i));
+        buckets_[i].Configure(class_limits.per_second, class_limits.burst);
+    }
+}
+
+std::optional<Error> ApiQuota::Admit(RequestClass request_class,
+                                     std::stop_token stop_token,
+                                     std::chrono::milliseconds max_wait) {
+    std::string_view name = kRequestClassNames[static_cast<size_t>(request_class)];
+
+    if (!buckets_[static_cast<size_t>(request_class)].Acquire(stop_token, max_wait)) {
+        if (stop_token.stop_requested()) {
+            return Error{"Request was cancelled", ErrorType::kNetworkError};
+        }
+
+        return Error{std::format("Too many {} requests are waiting for the rate limit", name), ErrorType::kNetworkError};
+    }
+
+    uint32_t per_day = GetLimits().Get(request_class).per_day;
+
+    if (!ledger_.TryReserve(request_class, per_day)) {
+        return Error{std::format("Daily quota of {} {} requests is used up", per_day, name), ErrorType::kApiError};
+    }
+
+    return std::nullopt;
+}
+
+std::optional<uint32_t> ApiQuota::GetRemaining(RequestClass request_class) const {
+    uint32_t per_day = GetLimits().Get(request_class).per_day;
+
+    if (per_day == 0) {
+        return std::nullopt;
+    }
+
+    return per_day - std::min(per_day, ledger_.GetUsed(request_class));
+}
+
+json ApiQuota::ToJson() const {
+    QuotaLimits limits = GetLimits();
+    json quota_obj{{"day", QuotaLedger::GetToday()}};
+
+    for (size_t i = 0; i < kRequestClassNames.size(); ++i) {
+        RequestClass request_class = static_cast<RequestClass>(i);
+        std::optional<uint32_t> remaining = GetRemaining(request_class);
+
+        quota_obj[std::string{kRequestClassNames[i]}] = {
+            {"used", ledger_.GetUsed(request_class)},
+            {"per_day", limits.Get(request_class).per_day},
+            {"remaining", remaining.has_value() ? json(remaining.value()) : json(nullptr)},
+            {"per_second", limits.Get(request_class).per_second}
+        };
+    }
+
+    return quota_obj;
+}
+
+QuotaLimits ApiQuota::GetLimits() const {
+    std::lock_guard lock{mutex_};
+    return limits_;
+}
+
+ApiQuota& GetApiQuota() {
+    static ApiQuota api_quota;
+    return api_quota;
+}
+
+} // namespace WayHome
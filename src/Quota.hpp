@@ -0,0 +1,130 @@
+#pragma once
+
+#include "ApiHandler.hpp" // for Error, ErrorType
+#include "FileLock.hpp"
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <string>
+#include <array>
+#include <optional>
+#include <chrono>
+#include <stop_token>
+#include <mutex>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+namespace WayHome {
+
+const std::string kQuotaDir{"wayhome_quota"};
+const std::string kQuotaLedgerFilename{"ledger.json"};
+const std::string kQuotaLockFilename{"lock"};
+
+enum class RequestClass {
+    kSearch,
+    kSuggests,
+    kCount
+};
+
+struct RequestClassLimits {
+    // Requests a day shared by all processes, 0 to not limit
+    uint32_t per_day = 0;
+    // Requests a second of the process and how many of them may go at once, 0 to not limit
+    double per_second = 0;
+    uint32_t burst = 1;
+};
+
+struct QuotaLimits {
+    // Searches a day on the free plan of the API
+    RequestClassLimits search{500, 5, 5};
+    // Suggestions are not counted by the API
+    RequestClassLimits suggests{0, 10, 10};
+
+    const RequestClassLimits& Get(RequestClass request_class) const;
+};
+
+bool ParseQuotaLimits(const json& obj, QuotaLimits& limits);
+
+// Spaces requests out: `rate` tokens a second are added up to `burst`, every request takes one
+class TokenBucket {
+public:
+    void Configure(double rate, uint32_t burst);
+
+    // Waits for a token in the order of arrival. False without taking one if the wait would be longer
+    // than `max_wait` or a stop was requested.
+    bool Acquire(std::stop_token stop_token, std::chrono::milliseconds max_wait);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Not limited and full until configured
+    double rate_ = 0;
+    double burst_ = std::numeric_limits<double>::infinity();
+    // Negative when tokens are promised to waiting requests
+    double tokens_ = std::numeric_limits<double>::infinity();
+    Clock::time_point updated_at_ = Clock::now();
+
+    std::mutex mutex_;
+
+    void Refill(Clock::time_point now);
+};
+
+// Requests made today per class, kept in a file shared by all processes.
+// The file is read and replaced under an exclusive lock of the lock file, so reservations are not lost.
+class QuotaLedger {
+public:
+    explicit QuotaLedger(std::string dir);
+
+    QuotaLedger(const QuotaLedger&) = delete;
+    QuotaLedger& operator=(const QuotaLedger&) = delete;
+
+    // Counts a request made today, false if `limit` (0 for none) requests were made already
+    bool TryReserve(RequestClass request_class, uint32_t limit);
+    uint32_t GetUsed(RequestClass request_class) const;
+
+    static std::string GetToday();
+
+private:
+    struct Usage {
+        std::string day;
+        std::array<uint32_t, static_cast<size_t>(RequestClass::kCount)> used{};
+    };
+
+    std::string dir_;
+    mutable FileLock file_lock_;
+
+    Usage Read() const;
+    bool Write(const Usage& usage) const;
+};
+
+// Admission of API requests: a token bucket per request class spaces them out in the process,
+// the ledger counts them against the daily limits of the API key
+class ApiQuota {
+public:
+    ApiQuota();
+
+    void SetLimits(const QuotaLimits& limits);
+
+    // Waits at most `max_wait` for the rate limit, reports an error if the request can't be made
+    std::optional<Error> Admit(RequestClass request_class, std::stop_token stop_token, std::chrono::milliseconds max_wait);
+
+    // Requests left for today, std::nullopt if the class has no daily limit
+    std::optional<uint32_t> GetRemaining(RequestClass request_class) const;
+
+    json ToJson() const;
+
+private:
+    QuotaLimits limits_;
+    QuotaLedger ledger_{kQuotaDir};
+    std::array<TokenBucket, static_cast<size_t>(RequestClass::kCount)> buckets_;
+
+    mutable std::mutex mutex_;
+
+    QuotaLimits GetLimits() const;
+};
+
+ApiQuota& GetApiQuota();
+
+} // namespace WayHome
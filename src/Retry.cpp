@@ -0,0 +1,162 @@
+#include "Retry.hpp"
+
+#include <random>
+#include <charconv>
+#include <algorithm>
+
+namespace WayHome {
+
+std::chrono::milliseconds RetryPolicy::GetBackoff(uint32_t attempt) const {
+    thread_local std::mt19937_64 generator{std::random_device{}()};
+
+    // Shifts past the cap would overflow
+    uint32_t exponent = std::min<uint32_t>(attempt == 0 ? 0 : attempt - 1, 20);
+    std::chrono::milliseconds ceiling = std::min(max_delay, base_delay * (int64_t{1} << exponent));
+
+    std::uniform_int_distribution<int64_t> distribution{0, std::max<int64_t>(ceiling.count(), 0)};
+    return std::chrono::milliseconds{distribution(generator)};
+}
+
+bool ParseRetryPolicy(const json& obj, RetryPolicy& policy) {
+    if (!obj.is_object()) {
+        return false;
+    }
+
+    for (const char* field : {"attempts", "base_delay_ms", "max_delay_ms", "breaker_failures", "breaker_open_seconds"}) {
+        if (obj.contains(field) && !obj[field].is_number_unsigned()) {
+            return false;
+        }
+    }
+
+    if (obj.contains("attempts")) {
+        if (obj["attempts"] == 0) {
+            return false;
+        }
+
+        policy.attempts = obj["attempts"];
+    }
+
+    if (obj.contains("base_delay_ms")) {
+        policy.base_delay = std::chrono::milliseconds{obj["base_delay_ms"].get<uint32_t>()};
+    }
+
+    if (obj.contains("max_delay_ms")) {
+        policy.max_delay = std::chrono::milliseconds{obj["max_delay_ms"].get<uint32_t>()};
+    }
+
+    if (obj.contains("breaker_failures")) {
+        policy.breaker_failures = obj["breaker_failures"];
+    }
+
+    if (obj.contains("breaker_open_seconds")) {
+        policy.breaker_open_time = std::chrono::seconds{obj["breaker_open_seconds"].get<uint32_t>()};
+    }
+
+    return true;
+}
+
+std::optional<std::chrono::milliseconds> ParseRetryAfter(std::string_view value) {
+    while (!value.empty() && value.front() == ' ') {
+        value.remove_prefix(1);
+    }
+
+    while (!value.empty() && value.back() == ' ') {
+        value.remove_suffix(1);
+    }
+
+    uint32_t seconds;
+    auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), seconds);
+
+    if (value.empty() || ec != std::errc{} || end != value.data() + value.size()) {
+        return std::nullopt;
+    }
+
+    return std::chrono::seconds{seconds};
+}
+
+void CircuitBreaker::Configure(uint32_t failure_threshold, std::chrono::seconds open_time) {
+    std::lock_guard lock{mutex_};
+
+    failure_threshold_ = failure_threshold;
+    open_time_ = open_time;
+}
+
+bool CircuitBreaker::TryAcquire() {
+    std::lock_guard lock{mutex_};
+
+    if (state_ == State::kClosed) {
+        return true;
+    }
+
+    if (state_ == State::kOpen && Clock::now() - opened_at_ >= open_time_) {
+        state_ = State::kHalfOpen;
+    }
+
+    // Only one probe at a time, the others fail fast until it's done
+    if (state_ == State::kHalfOpen && !is_probing_) {
+        is_probing_ = true;
+        return true;
+    }
+
+    return false;
+}
+
+void CircuitBreaker::RecordSuccess() {
+    std::lock_guard lock{mutex_};
+
+    state_ = State::kClosed;
+    failures_ = 0;
+    is_probing_ = false;
+}
+
+void CircuitBreaker::RecordFailure() {
+    std::lock_guard lock{mutex_};
+
+    ++failures_;
+
+    if (state_ == State::kHalfOpen || (failure_threshold_ != 0 && failures_ >= failure_threshold_)) {
+        state_ = State::kOpen;
+        opened_at_ = Clock::now();
+    }
+
+    is_probing_ = false;
+}
+
+void CircuitBreaker::Release() {
+    std::lock_guard lock{mutex_};
+    is_probing_ = false;
+}
+
+bool CircuitBreaker::IsOpen() const {
+    std::lock_guard lock{mutex_};
+    return state_ == State::kOpen && Clock::now() - opened_at_ < open_time_;
+}
+
+ApiResilience::ApiResilience() {
+    SetPolicy(RetryPolicy{});
+}
+
+void ApiResilience::SetPolicy(const RetryPolicy& policy) {
+    std::lock_guard lock{mutex_};
+    policy_ = policy;
+
+    for (CircuitBreaker& breaker : breakers_) {
+        breaker.Configure(policy_.breaker_failures, policy_.breaker_open_time);
+    }
+}
+
+RetryPolicy ApiResilience::GetPolicy() const {
+    std::lock_guard lock{mutex_};
+    return policy_;
+}
+
+CircuitBreaker& ApiResilience::GetBreaker(RequestClass request_class) {
+    return breakers_[static_cast<size_t>(request_class)];
+}
+
+ApiResilience& GetApiResilience() {
+    static ApiResilience api_resilience;
+    return api_resilience;
+}
+
+} // namespace WayHome
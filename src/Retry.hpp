@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Quota.hpp" // for RequestClass
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <array>
+#include <chrono>
+#include <optional>
+#include <string_view>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace WayHome {
+
+struct RetryPolicy {
+    // Attempts of a request, including the first one
+    uint32_t attempts = 3;
+    std::chrono::milliseconds base_delay{500};
+    // Longer waits, including the ones asked for by Retry-After, are not made
+    std::chrono::milliseconds max_delay{8000};
+
+    // Failed attempts in a row after which requests fail fast for `breaker_open_time`, 0 to never
+    uint32_t breaker_failures = 5;
+    std::chrono::seconds breaker_open_time{30};
+
+    // Uniformly random delay up to base_delay * 2^(attempt - 1), capped by max_delay
+    std::chrono::milliseconds GetBackoff(uint32_t attempt) const;
+};
+
+bool ParseRetryPolicy(const json& obj, RetryPolicy& policy);
+
+// Delay of a Retry-After header given in seconds, HTTP dates are not supported
+std::optional<std::chrono::milliseconds> ParseRetryAfter(std::string_view value);
+
+// Stops requests to an unhealthy upstream. Opens after `failure_threshold` failures in a row;
+// when `open_time` has passed, one request is let through to probe the upstream,
+// its success closes the breaker and its failure opens it again.
+class CircuitBreaker {
+public:
+    void Configure(uint32_t failure_threshold, std::chrono::seconds open_time);
+
+    // False if the request must not be made. A granted request must end with one of the three calls below.
+    bool TryAcquire();
+    void RecordSuccess();
+    void RecordFailure();
+    // The request wasn't made after all
+    void Release();
+
+    bool IsOpen() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    enum class State {
+        kClosed,
+        kOpen,
+        kHalfOpen
+    };
+
+    uint32_t failure_threshold_ = 0;
+    std::chrono::seconds open_time_{0};
+
+    State state_ = State::kClosed;
+    uint32_t failures_ = 0;
+    Clock::time_point opened_at_;
+    bool is_probing_ = false;
+
+    mutable std::mutex mutex_;
+};
+
+// Retry policy and a circuit breaker per request class, shared by all API requests of the process
+class ApiResilience {
+public:
+    ApiResilience();
+
+    void SetPolicy(const RetryPolicy& policy);
+    RetryPolicy GetPolicy() const;
+
+    CircuitBreaker& GetBreaker(RequestClass request_class);
+
+private:
+    RetryPolicy policy_;
+    std::array<CircuitBreaker, static_cast<size_t>(RequestClass::kCount)> breakers_;
+
+    mutable std::mutex mutex_;
+};
+
+ApiResilience& GetApiResilience();
+
+} // namespace WayHome
@@ -1,10 +1,72 @@
 #include "Route.hpp"
+#include "Binary.hpp"
 
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
 
 namespace WayHome {
 
+namespace {
+
+void SerializeRoutePoint(std::string& to, const RoutePoint& point) {
+    AppendBinary(to, point.code);
+    AppendBinary(to, point.type);
+    AppendBinary(to, point.title);
+    AppendBinary(to, point.station_type);
+}
+
+bool ReadRoutePoint(std::string_view& from, RoutePoint& point) {
+    return ReadBinary(from, point.code)
+        && ReadBinary(from, point.type)
+        && ReadBinary(from, point.title)
+        && ReadBinary(from, point.station_type);
+}
+
+void SerializeThread(std::string& to, const Thread& thread) {
+    SerializeRoutePoint(to, thread.start_point);
+    SerializeRoutePoint(to, thread.end_point);
+
+    AppendBinary(to, thread.vehicle);
+    AppendBinary(to, thread.number);
+    AppendBinary(to, thread.transport_type);
+    AppendBinary(to, thread.carrier_name);
+    AppendBinary(to, thread.departure_time);
+    AppendBinary(to, thread.arrival_time);
+    AppendBinary(to, thread.duration);
+}
+
+bool ReadThread(std::string_view& from, Thread& thread) {
+    return ReadRoutePoint(from, thread.start_point)
+        && ReadRoutePoint(from, thread.end_point)
+        && ReadBinary(from, thread.vehicle)
+        && ReadBinary(from, thread.number)
+        && ReadBinary(from, thread.transport_type)
+        && ReadBinary(from, thread.carrier_name)
+        && ReadBinary(from, thread.departure_time)
+        && ReadBinary(from, thread.arrival_time)
+        && ReadBinary(from, thread.duration);
+}
+
+void SerializeTransfer(std::string& to, const Transfer& transfer) {
+    AppendBinary(to, transfer.duration);
+
+    SerializeRoutePoint(to, transfer.transfer_point);
+    SerializeRoutePoint(to, transfer.station1);
+    SerializeRoutePoint(to, transfer.station2);
+
+    AppendBinary(to, transfer.next_transport_type);
+}
+
+bool ReadTransfer(std::string_view& from, Transfer& transfer) {
+    return ReadBinary(from, transfer.duration)
+        && ReadRoutePoint(from, transfer.transfer_point)
+        && ReadRoutePoint(from, transfer.station1)
+        && ReadRoutePoint(from, transfer.station2)
+        && ReadBinary(from, transfer.next_transport_type);
+}
+
+} // namespace
+
 bool Route::BuildFromJson(const json& segment) {
     if (segment.contains("has_transfers") && segment["has_transfers"]) {
         return BuildWithTransfers(segment);
@@ -248,6 +310,72 @@ bool Route::AddTransfer(const json& transfer_obj) {
     return true;
 }
 
+bool Route::BuildFromBinary(std::string_view& from) {
+    uint32_t threads_count;
+    uint32_t transfers_count;
+
+    // Every element takes more than one byte, so the counts are bounded by the data size
+    if (!ReadBinary(from, threads_count) || threads_count > from.size()) {
+        error_ = {"Invalid binary route: no threads", ErrorType::kDataError};
+        return false;
+    }
+
+    threads_.resize(threads_count);
+
+    for (Thread& thread : threads_) {
+        if (!ReadThread(from, thread)) {
+            error_ = {"Invalid binary route: unable to read thread", ErrorType::kDataError};
+            return false;
+        }
+    }
+
+    if (!ReadBinary(from, transfers_count) || transfers_count > from.size()) {
+        error_ = {"Invalid binary route: no transfers", ErrorType::kDataError};
+        return false;
+    }
+
+    transfers_.resize(transfers_count);
+
+    for (Transfer& transfer : transfers_) {
+        if (!ReadTransfer(from, transfer)) {
+            error_ = {"Invalid binary route: unable to read transfer", ErrorType::kDataError};
+            return false;
+        }
+    }
+
+    if (!ReadRoutePoint(from, start_point_)
+    || !ReadRoutePoint(from, end_point_)
+    || !ReadBinary(from, departure_time_)
+    || !ReadBinary(from, arrival_time_)
+    || !ReadBinary(from, duration_)) {
+        error_ = {"Invalid binary route: unable to read route info", ErrorType::kDataError};
+        return false;
+    }
+
+    return true;
+}
+
+void Route::SerializeToBinary(std::string& to) const {
+    AppendBinary(to, static_cast<uint32_t>(threads_.size()));
+
+    for (const Thread& thread : threads_) {
+        SerializeThread(to, thread);
+    }
+
+    AppendBinary(to, static_cast<uint32_t>(transfers_.size()));
+
+    for (const Transfer& transfer : transfers_) {
+        SerializeTransfer(to, transfer);
+    }
+
+    SerializeRoutePoint(to, start_point_);
+    SerializeRoutePoint(to, end_point_);
+
+    AppendBinary(to, departure_time_);
+    AppendBinary(to, arrival_time_);
+    AppendBinary(to, duration_);
+}
+
 const std::string& Route::GetArrivalTime() const {
     return arrival_time_;
 }
@@ -9,6 +9,7 @@ using json = nlohmann::json;
 #include <vector>
 #include <expected>
 #include <cstdint>
+#include <string_view>
 
 namespace WayHome {
 
@@ -20,7 +21,7 @@ struct RoutePoint {
 };
 
 struct Transfer {
-    uint32_t duration;
+    uint32_t duration = 0;
 
     RoutePoint transfer_point;
     RoutePoint station1;
@@ -40,13 +41,17 @@ struct Thread {
     std::string departure_time;
     std::string arrival_time;
     
-    uint32_t duration;
+    uint32_t duration = 0;
 };
 
 class Route {
 public:
     bool BuildFromJson(const json& segment);
 
+    // Binary form used by the routes cache, `from` is advanced past the route
+    bool BuildFromBinary(std::string_view& from);
+    void SerializeToBinary(std::string& to) const;
+
     const std::string& GetDepartureTime() const;
     const std::string& GetArrivalTime() const;
 
@@ -76,7 +81,7 @@ private:
     std::string departure_time_;
     std::string arrival_time_;
 
-    uint32_t duration_;
+    uint32_t duration_ = 0;
 
     Error error_;
 
@@ -1,8 +1,25 @@
 #include "RoutesHandler.hpp"
+#include "Binary.hpp"
+#include "Checksum.hpp"
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <format>
 
 namespace WayHome {
 
+namespace {
+
+const uint32_t kRoutesBinaryMagic = 0x42524857; // "WHRB"
+const uint32_t kRoutesBinaryVersion = 1;
+
+// magic, version, crc of the payload
+const size_t kRoutesBinaryHeaderSize = 4 + 4 + 4;
+
+} // namespace
+
 bool RoutesHandler::BuildFromJson(const json& response_obj) {
+    ScopedTimer timer{Stage::kBuildFromJson};
     Clear();
     
     if (!response_obj.contains("search")) {
@@ -49,6 +66,100 @@ bool RoutesHandler::BuildFromJson(const json& response_obj) {
     return true;
 }
 
+bool RoutesHandler::BuildFromBinary(std::string_view data) {
+    ScopedTimer timer{Stage::kBuildFromBinary};
+    uint32_t routes_count;
+
+    if (!ReadBinaryHeader(data, routes_count)) {
+        return false;
+    }
+
+    routes_.resize(routes_count);
+
+    for (Route& route : routes_) {
+        if (!route.BuildFromBinary(data)) {
+            error_ = route.GetError();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool RoutesHandler::ReadBinaryHeader(std::string_view& data, uint32_t& routes_count) {
+    Clear();
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t crc;
+
+    if (!ReadBinary(data, magic) || !ReadBinary(data, version) || !ReadBinary(data, crc) || magic != kRoutesBinaryMagic) {
+        error_ = {"Invalid binary routes: bad header", ErrorType::kDataError};
+        return false;
+    }
+
+    if (version != kRoutesBinaryVersion) {
+        error_ = {"Invalid binary routes: unsupported version " + std::to_string(version), ErrorType::kDataError};
+        return false;
+    }
+
+    if (Crc32(data) != crc) {
+        error_ = {"Invalid binary routes: checksum mismatch", ErrorType::kDataError};
+        return false;
+    }
+
+    if (!ReadBinary(data, start_point_.code)
+    || !ReadBinary(data, start_point_.type)
+    || !ReadBinary(data, start_point_.title)
+    || !ReadBinary(data, start_point_.station_type)
+    || !ReadBinary(data, end_point_.code)
+    || !ReadBinary(data, end_point_.type)
+    || !ReadBinary(data, end_point_.title)
+    || !ReadBinary(data, end_point_.station_type)
+    || !ReadBinary(data, departure_date_)
+    || !ReadBinary(data, routes_count)
+    || routes_count > data.size()) {
+        error_ = {"Invalid binary routes: unable to read search info", ErrorType::kDataError};
+        return false;
+    }
+
+    return true;
+}
+
+std::string RoutesHandler::SerializeToBinary() const {
+    std::string payload;
+
+    AppendBinary(payload, start_point_.code);
+    AppendBinary(payload, start_point_.type);
+    AppendBinary(payload, start_point_.title);
+    AppendBinary(payload, start_point_.station_type);
+    AppendBinary(payload, end_point_.code);
+    AppendBinary(payload, end_point_.type);
+    AppendBinary(payload, end_point_.title);
+    AppendBinary(payload, end_point_.station_type);
+    AppendBinary(payload, departure_date_);
+    AppendBinary(payload, static_cast<uint32_t>(routes_.size()));
+
+    for (const Route& route : routes_) {
+        route.SerializeToBinary(payload);
+    }
+
+    std::string data;
+    data.reserve(kRoutesBinaryHeaderSize + payload.size());
+
+    AppendBinary(data, kRoutesBinaryMagic);
+    AppendBinary(data, kRoutesBinaryVersion);
+    AppendBinary(data, Crc32(payload));
+    data.append(payload);
+
+    return data;
+}
+
+bool RoutesHandler::IsBinary(std::string_view data) {
+    uint32_t magic;
+    return ReadBinary(data, magic) && magic == kRoutesBinaryMagic;
+}
+
 bool RoutesHandler::AddRoute(const json& segment) {
     Route route;
 
@@ -104,7 +215,9 @@ void RoutesHandler::DumpRoutesPretty(std::ostream& stream, uint32_t max_transfer
     }
 }
 
-void RoutesHandler::DumpRoutesToJson(std::ostream& stream, uint32_t max_transfers) const {
+void RoutesHandler::DumpRoutesToJson(std::ostream& stream,
+                                     uint32_t max_transfers,
+                                     std::optional<int64_t> stale_seconds) const {
     json obj;
     obj["from"] = {
         {"code", start_point_.code},
@@ -118,6 +231,10 @@ void RoutesHandler::DumpRoutesToJson(std::ostream& stream, uint32_t max_transfer
 
     obj["departure"] = departure_date_;
 
+    if (stale_seconds.has_value()) {
+        obj["stale_seconds"] = stale_seconds.value();
+    }
+
     obj["routes"] = json::array();
     
     for (const Route& route : routes_) {
@@ -216,6 +333,27 @@ void RoutesHandler::DumpRoutesToJson(std::ostream& stream, uint32_t max_transfer
     stream << std::setw(4) << obj;
 }
 
+void RoutesHandler::Merge(const RoutesHandler& other) {
+    if (departure_date_.empty()) {
+        start_point_ = other.start_point_;
+        end_point_ = other.end_point_;
+        departure_date_ = other.departure_date_;
+    } else if (!other.departure_date_.empty()) {
+        std::string_view first = departure_date_.substr(0, departure_date_.find('/'));
+        std::string_view last = departure_date_.substr(departure_date_.rfind('/') + 1);
+        std::string_view other_first = other.departure_date_.substr(0, other.departure_date_.find('/'));
+        std::string_view other_last = other.departure_date_.substr(other.departure_date_.rfind('/') + 1);
+
+        first = std::min(first, other_first);
+        last = std::max(last, other_last);
+
+        departure_date_ = first == last ? std::string{first} : std::format("{}/{}", first, last);
+    }
+
+    routes_.insert(routes_.end(), other.routes_.begin(), other.routes_.end());
+    std::ranges::stable_sort(routes_, {}, &Route::GetDepartureTime);
+}
+
 void RoutesHandler::Clear() {
     start_point_ = {};
     end_point_ = {};
@@ -223,6 +361,33 @@ void RoutesHandler::Clear() {
     routes_.clear();
 }
 
+size_t RoutesHandler::GetApproximateSize() const {
+    auto point_size = [](const RoutePoint& point) {
+        return sizeof(RoutePoint) + point.code.size() + point.type.size() 
+            + point.title.size() + point.station_type.size();
+    };
+
+    size_t size = sizeof(RoutesHandler) + point_size(start_point_) + point_size(end_point_) + departure_date_.size();
+
+    for (const Route& route : routes_) {
+        size += sizeof(Route) + point_size(route.GetStartPoint()) + point_size(route.GetEndPoint())
+            + route.GetDepartureTime().size() + route.GetArrivalTime().size();
+
+        for (const Thread& thread : route.GetThreads()) {
+            size += sizeof(Thread) + point_size(thread.start_point) + point_size(thread.end_point)
+                + thread.vehicle.size() + thread.number.size() + thread.transport_type.size()
+                + thread.carrier_name.size() + thread.departure_time.size() + thread.arrival_time.size();
+        }
+
+        for (const Transfer& transfer : route.GetTransfers()) {
+            size += sizeof(Transfer) + point_size(transfer.transfer_point) + point_size(transfer.station1)
+                + point_size(transfer.station2) + transfer.next_transport_type.size();
+        }
+    }
+
+    return size;
+}
+
 const Error& RoutesHandler::GetError() const {
     return error_;
 }
@@ -8,22 +8,41 @@ using json = nlohmann::json;
 #include <string>
 #include <vector>
 #include <ostream>
+#include <string_view>
+#include <optional>
+#include <cstdint>
 
 namespace WayHome {
 
 class RoutesHandler {
 public:
     bool BuildFromJson(const json& response_obj);
+
+    // Versioned and checksummed binary form, lets cache hits skip the JSON parsing
+    bool BuildFromBinary(std::string_view data);
+    std::string SerializeToBinary() const;
+    static bool IsBinary(std::string_view data);
+
     const std::vector<Route>& GetRoutes() const;
 
     const RoutePoint& GetStartPoint() const;
     const RoutePoint& GetEndPoint() const;
 
-    void DumpRoutesToJson(std::ostream& stream, uint32_t max_transfers) const;
+    // Adds the routes found between the same points on another date, routes stay ordered by departure.
+    // The departure date becomes an ISO 8601 interval covering both.
+    void Merge(const RoutesHandler& other);
+
+    // `stale_seconds` is set for routes served from an expired cache entry
+    void DumpRoutesToJson(std::ostream& stream,
+                          uint32_t max_transfers,
+                          std::optional<int64_t> stale_seconds = std::nullopt) const;
     void DumpRoutesPretty(std::ostream& stream, uint32_t max_transfers) const;
     
     void Clear();
 
+    // Rough heap footprint, used to bound the memory cache
+    size_t GetApproximateSize() const;
+
     const Error& GetError() const;
     bool HasError() const;
 
@@ -37,6 +56,7 @@ private:
     Error error_;
 
     bool AddRoute(const json& segment);
+    bool ReadBinaryHeader(std::string_view& data, uint32_t& routes_count);
 };
     
 } // namespace WayHome
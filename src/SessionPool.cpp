@@ -0,0 +1,175 @@
+#include "SessionPool.hpp"
+#include "Metrics.hpp"
+
+namespace WayHome {
+
+bool ParseSessionPoolOptions(const json& obj, SessionPoolOptions& options) {
+    if (!obj.is_object()) {
+        return false;
+    }
+
+    if (obj.contains("pool_size")) {
+        if (!obj["pool_size"].is_number_unsigned()) {
+            return false;
+        }
+
+        options.max_idle = obj["pool_size"];
+    }
+
+    if (obj.contains("http2")) {
+        if (!obj["http2"].is_boolean()) {
+            return false;
+        }
+
+        options.http2 = obj["http2"];
+    }
+
+    if (obj.contains("compression")) {
+        if (!obj["compression"].is_boolean()) {
+            return false;
+        }
+
+        options.compression = obj["compression"];
+    }
+
+    if (obj.contains("dns_cache_seconds")) {
+        if (!obj["dns_cache_seconds"].is_number_unsigned()) {
+            return false;
+        }
+
+        options.dns_cache_ttl = std::chrono::seconds{obj["dns_cache_seconds"].get<uint32_t>()};
+    }
+
+    return true;
+}
+
+SessionPool::Lease::~Lease() {
+    if (session_ != nullptr) {
+        pool_->Release(std::move(session_));
+    }
+}
+
+cpr::Session& SessionPool::Lease::operator*() const {
+    return *session_;
+}
+
+cpr::Session* SessionPool::Lease::operator->() const {
+    return session_.get();
+}
+
+void SessionPool::Lease::CountConnection() const {
+    long connects = 0;
+
+    if (curl_easy_getinfo(session_->GetCurlHolder()->handle, CURLINFO_NUM_CONNECTS, &connects) != CURLE_OK) {
+        return;
+    }
+
+    GetMetrics().Increment(connects == 0 ? Counter::kApiConnectionsReused : Counter::kApiConnectionsOpened);
+}
+
+SessionPool::SessionPool()
+    : share_(curl_share_init()) {
+    if (share_ == nullptr) {
+        return;
+    }
+
+    curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &SessionPool::LockShare);
+    curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &SessionPool::UnlockShare);
+    curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+SessionPool::~SessionPool() {
+    // Sessions must let go of the share handle before it is cleaned up
+    idle_.clear();
+
+    if (share_ != nullptr) {
+        curl_share_cleanup(share_);
+    }
+}
+
+void SessionPool::Configure(const SessionPoolOptions& options) {
+    std::lock_guard lock{mutex_};
+    options_ = options;
+
+    if (idle_.size() > options_.max_idle) {
+        idle_.resize(options_.max_idle);
+    }
+}
+
+SessionPool::Lease SessionPool::Acquire() {
+    {
+        std::lock_guard lock{mutex_};
+
+        if (!idle_.empty()) {
+            std::unique_ptr<cpr::Session> session = std::move(idle_.back());
+            idle_.pop_back();
+
+            return Lease{*this, std::move(session)};
+        }
+    }
+
+    return Lease{*this, MakeSession()};
+}
+
+size_t SessionPool::GetIdleCount() const {
+    std::lock_guard lock{mutex_};
+    return idle_.size();
+}
+
+std::unique_ptr<cpr::Session> SessionPool::MakeSession() const {
+    SessionPoolOptions options;
+
+    {
+        std::lock_guard lock{mutex_};
+        options = options_;
+    }
+
+    auto session = std::make_unique<cpr::Session>();
+
+    if (options.http2) {
+        // Servers without HTTP/2 are talked to over HTTP/1.1
+        session->SetHttpVersion(cpr::HttpVersion{cpr::HttpVersionCode::VERSION_2_0_TLS});
+    }
+
+    if (options.compression) {
+        // No methods listed lets curl offer every encoding it was built with (gzip, deflate, brotli, zstd)
+        session->SetAcceptEncoding(cpr::AcceptEncoding{});
+    } else {
+        session->SetAcceptEncoding(cpr::AcceptEncoding{cpr::AcceptEncodingMethods::disabled});
+    }
+
+    CURL* handle = session->GetCurlHolder()->handle;
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, static_cast<long>(options.dns_cache_ttl.count()));
+
+    if (share_ != nullptr) {
+        curl_easy_setopt(handle, CURLOPT_SHARE, share_);
+    }
+
+    return session;
+}
+
+void SessionPool::Release(std::unique_ptr<cpr::Session> session) {
+    std::lock_guard lock{mutex_};
+
+    if (idle_.size() < options_.max_idle) {
+        idle_.push_back(std::move(session));
+    }
+}
+
+void SessionPool::LockShare(CURL*, curl_lock_data data, curl_lock_access, void* pool) {
+    static_cast<SessionPool*>(pool)->share_mutexes_[data].lock();
+}
+
+void SessionPool::UnlockShare(CURL*, curl_lock_data data, void* pool) {
+    static_cast<SessionPool*>(pool)->share_mutexes_[data].unlock();
+}
+
+SessionPool& GetSessionPool() {
+    static SessionPool session_pool;
+    return session_pool;
+}
+
+} // namespace WayHome
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cpr/cpr.h>
+#include <curl/curl.h>
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstddef>
+
+namespace WayHome {
+
+struct SessionPoolOptions {
+    // Idle sessions kept open, more may be in use at the same time
+    size_t max_idle = 8;
+    bool http2 = true;
+    // Ask for compressed responses, they are decoded before the body is handed out
+    bool compression = true;
+    std::chrono::seconds dns_cache_ttl{300};
+};
+
+bool ParseSessionPoolOptions(const json& obj, SessionPoolOptions& options);
+
+// Reusable cpr sessions of the process.
+// A session keeps its connection to the API host alive between requests, so only the first request
+// of a session pays for the TCP and TLS handshakes. All sessions share the DNS cache and the TLS sessions,
+// so a new one resolves nothing and resumes TLS. Whether a request reused a connection is counted in Metrics.
+class SessionPool {
+public:
+    // Returns the session to the pool when destroyed
+    class Lease {
+    public:
+        Lease(SessionPool& pool, std::unique_ptr<cpr::Session> session)
+            : pool_(&pool)
+            , session_(std::move(session)) {}
+
+        ~Lease();
+
+        Lease(Lease&& other) = default;
+        Lease& operator=(Lease&& other) = delete;
+
+        cpr::Session& operator*() const;
+        cpr::Session* operator->() const;
+
+        // Counts the connection the last request was made over as a new or a reused one
+        void CountConnection() const;
+
+    private:
+        SessionPool* pool_;
+        std::unique_ptr<cpr::Session> session_;
+    };
+
+    SessionPool();
+    ~SessionPool();
+
+    SessionPool(const SessionPool&) = delete;
+    SessionPool& operator=(const SessionPool&) = delete;
+
+    // Applies to the sessions created afterwards, extra idle sessions are closed
+    void Configure(const SessionPoolOptions& options);
+
+    Lease Acquire();
+
+    size_t GetIdleCount() const;
+
+private:
+    SessionPoolOptions options_;
+    std::vector<std::unique_ptr<cpr::Session>> idle_;
+
+    CURLSH* share_ = nullptr;
+    // One per curl_lock_data the share handle asks for
+    std::array<std::mutex, CURL_LOCK_DATA_LAST> share_mutexes_;
+
+    mutable std::mutex mutex_;
+
+    std::unique_ptr<cpr::Session> MakeSession() const;
+    void Release(std::unique_ptr<cpr::Session> session);
+
+    static void LockShare(CURL* handle, curl_lock_data data, curl_lock_access access, void* pool);
+    static void UnlockShare(CURL* handle, curl_lock_data data, void* pool);
+};
+
+SessionPool& GetSessionPool();
+
+} // namespace WayHome
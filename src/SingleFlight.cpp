@@ -0,0 +1,80 @@
+#include "SingleFlight.hpp"
+#include "Metrics.hpp"
+
+namespace WayHome {
+
+SingleFlight::Result SingleFlight::Do(const std::string& key,
+                                      const std::function<Result()>& request,
+                                      const std::stop_token& stop_token) {
+    bool is_counted = false;
+
+    while (true) {
+        std::unique_lock lock{mutex_};
+        auto it = flights_.find(key);
+
+        if (it != flights_.end()) {
+            std::shared_ptr<Flight> flight = it->second;
+            lock.unlock();
+
+            if (!is_counted) {
+                GetMetrics().Increment(Counter::kApiRequestsCoalesced);
+                is_counted = true;
+            }
+
+            while (flight->result.wait_for(kSingleFlightPollInterval) != std::future_status::ready) {
+                if (stop_token.stop_requested()) {
+                    return std::unexpected{Error{"Request was cancelled", ErrorType::kNetworkError}};
+                }
+            }
+
+            // Someone else's cancellation is not an answer
+            if (!flight->is_cancelled) {
+                return flight->result.get();
+            }
+
+            continue;
+        }
+
+        std::shared_ptr<Flight> flight = std::make_shared<Flight>();
+        std::promise<Result> promise;
+        flight->result = promise.get_future().share();
+        flights_.emplace(key, flight);
+        lock.unlock();
+
+        Result result;
+
+        try {
+            result = request();
+        } catch (...) {
+            lock.lock();
+            flights_.erase(key);
+            lock.unlock();
+
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+
+        flight->is_cancelled = stop_token.stop_requested();
+
+        // Callers coming after this point make a new request, the waiters already have the flight
+        lock.lock();
+        flights_.erase(key);
+        lock.unlock();
+
+        promise.set_value(result);
+
+        return result;
+    }
+}
+
+size_t SingleFlight::GetInFlight() const {
+    std::lock_guard lock{mutex_};
+    return flights_.size();
+}
+
+SingleFlight& GetSingleFlight() {
+    static SingleFlight single_flight;
+    return single_flight;
+}
+
+} // namespace WayHome
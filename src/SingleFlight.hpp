@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ApiHandler.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <future>
+#include <functional>
+#include <stop_token>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <expected>
+
+namespace WayHome {
+
+// How often a waiter looks at its own stop token
+const std::chrono::milliseconds kSingleFlightPollInterval{50};
+
+// Coalesces identical API requests made at the same time. The first caller of a key makes the request,
+// the callers that come while it's in flight wait for it and get a copy of its parsed result.
+// Nothing is kept after the request is done, remembering results is the job of the caches.
+class SingleFlight {
+public:
+    using Result = std::expected<json, Error>;
+
+    // `stop_token` is the one `request` was given. A waiter stops waiting when a stop is requested for its own token;
+    // if the request it waited for was cancelled instead, the waiter makes the request itself.
+    Result Do(const std::string& key, const std::function<Result()>& request, const std::stop_token& stop_token);
+
+    size_t GetInFlight() const;
+
+private:
+    struct Flight {
+        std::shared_future<Result> result;
+        std::atomic<bool> is_cancelled = false;
+    };
+
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+    mutable std::mutex mutex_;
+};
+
+SingleFlight& GetSingleFlight();
+
+} // namespace WayHome
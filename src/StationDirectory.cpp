@@ -0,0 +1,355 @@
+#include "StationDirectory.hpp"
+#include "Binary.hpp"
+
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace WayHome {
+
+namespace {
+
+const uint32_t kDirectoryMagic = 0x44534857; // "WHSD"
+const uint32_t kDirectoryVersion = 1;
+const size_t kDirectoryHeaderSize = 4 * sizeof(uint32_t);
+
+const size_t kPointRecordSize = 4 * sizeof(uint32_t);
+const size_t kNameRecordSize = 2 * sizeof(uint32_t);
+
+struct ImportedPoint {
+    RoutePoint point;
+    uint32_t code = 0;
+    uint32_t title = 0;
+    uint32_t type = 0;
+    uint32_t station_type = 0;
+};
+
+// Strings are stored once, prefixed with their size
+class StringPool {
+public:
+    uint32_t Add(const std::string& value) {
+        auto [it, is_inserted] = offsets_.try_emplace(value, static_cast<uint32_t>(data_.size()));
+
+        if (is_inserted) {
+            AppendBinary(data_, std::string_view{value});
+        }
+
+        return it->second;
+    }
+
+    const std::string& GetData() const {
+        return data_;
+    }
+
+private:
+    std::string data_;
+    std::unordered_map<std::string, uint32_t> offsets_;
+};
+
+std::string GetYandexCode(const json& obj) {
+    if (!obj.contains("codes") || !obj["codes"].is_object()) {
+        return {};
+    }
+
+    const json& codes = obj["codes"];
+
+    if (!codes.contains("yandex_code") || !codes["yandex_code"].is_string()) {
+        return {};
+    }
+
+    return codes["yandex_code"];
+}
+
+std::string GetString(const json& obj, const char* field) {
+    if (!obj.contains(field) || !obj[field].is_string()) {
+        return {};
+    }
+
+    return obj[field];
+}
+
+void AddPoint(std::vector<ImportedPoint>& points, const json& obj, const std::string& type) {
+    std::string code = GetYandexCode(obj);
+    std::string title = GetString(obj, "title");
+
+    // Points without a code can't be searched for, the ones without a title can't be found
+    if (code.empty() || title.empty()) {
+        return;
+    }
+
+    ImportedPoint imported;
+    imported.point = {std::move(code), type, std::move(title), GetString(obj, "station_type")};
+
+    points.push_back(std::move(imported));
+}
+
+void CollectPoints(std::vector<ImportedPoint>& points, const json& stations_list) {
+    auto get_array = [](const json& obj, const char* field) -> const json& {
+        static const json kEmpty = json::array();
+        return obj.contains(field) && obj[field].is_array() ? obj[field] : kEmpty;
+    };
+
+    for (const json& country : get_array(stations_list, "countries")) {
+        for (const json& region : get_array(country, "regions")) {
+            for (const json& settlement : get_array(region, "settlements")) {
+                AddPoint(points, settlement, "settlement");
+
+                for (const json& station : get_array(settlement, "stations")) {
+                    AddPoint(points, station, "station");
+                }
+            }
+        }
+    }
+}
+
+} // namespace
+
+std::expected<size_t, Error> StationDirectory::Import(const std::string& stations_list_path, const std::string& path) {
+    std::ifstream input{stations_list_path};
+
+    if (!input.good()) {
+        return std::unexpected{Error{"Unable to open " + stations_list_path, ErrorType::kEnvironmentError}};
+    }
+
+    json stations_list = json::parse(input, nullptr, false);
+
+    if (!stations_list.is_object() || !stations_list.contains("countries")) {
+        return std::unexpected{Error{"Stations list doesn't have \"countries\" array: " + stations_list_path,
+                                     ErrorType::kDataError}};
+    }
+
+    std::vector<ImportedPoint> points;
+    CollectPoints(points, stations_list);
+
+    std::ranges::stable_sort(points, {}, [](const ImportedPoint& imported) -> const std::string& {
+        return imported.point.code;
+    });
+
+    // Settlements are listed by every region they are in
+    auto duplicates = std::ranges::unique(points, {}, [](const ImportedPoint& imported) -> const std::string& {
+        return imported.point.code;
+    });
+    points.erase(duplicates.begin(), duplicates.end());
+
+    StringPool pool;
+
+    for (ImportedPoint& imported : points) {
+        imported.code = pool.Add(imported.point.code);
+        imported.title = pool.Add(imported.point.title);
+        imported.type = pool.Add(imported.point.type);
+        imported.station_type = pool.Add(imported.point.station_type);
+    }
+
+    std::vector<uint32_t> by_title(points.size());
+
+    for (uint32_t i = 0; i < by_title.size(); ++i) {
+        by_title[i] = i;
+    }
+
+    std::ranges::stable_sort(by_title, {}, [&points](uint32_t index) -> const std::string& {
+        return points[index].point.title;
+    });
+
+    std::string data;
+    data.reserve(kDirectoryHeaderSize + points.size() * (kPointRecordSize + kNameRecordSize) + pool.GetData().size());
+
+    AppendBinary(data, kDirectoryMagic);
+    AppendBinary(data, kDirectoryVersion);
+    AppendBinary(data, static_cast<uint32_t>(points.size()));
+    AppendBinary(data, static_cast<uint32_t>(by_title.size()));
+
+    for (const ImportedPoint& imported : points) {
+        AppendBinary(data, imported.code);
+        AppendBinary(data, imported.title);
+        AppendBinary(data, imported.type);
+        AppendBinary(data, imported.station_type);
+    }
+
+    for (uint32_t index : by_title) {
+        AppendBinary(data, points[index].title);
+        AppendBinary(data, index);
+    }
+
+    data.append(pool.GetData());
+
+    // Searches that have the directory open keep reading the old file
+    std::string temp_path = path + ".tmp";
+
+    {
+        std::ofstream output{temp_path, std::ios::binary | std::ios::trunc};
+
+        if (!output.write(data.data(), data.size()) || !output.flush()) {
+            return std::unexpected{Error{"Unable to write " + temp_path, ErrorType::kEnvironmentError}};
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+
+    if (ec) {
+        return std::unexpected{Error{"Unable to write " + path, ErrorType::kEnvironmentError}};
+    }
+
+    return points.size();
+}
+
+bool StationDirectory::Open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < kDirectoryHeaderSize) {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    auto mapping = std::make_shared<const SegmentMapping>(static_cast<const char*>(data), st.st_size);
+    std::string_view from = mapping->GetData();
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t point_count;
+    uint32_t name_count;
+
+    ReadBinary(from, magic);
+    ReadBinary(from, version);
+    ReadBinary(from, point_count);
+    ReadBinary(from, name_count);
+
+    if (magic != kDirectoryMagic || version != kDirectoryVersion
+    || from.size() < static_cast<uint64_t>(point_count) * kPointRecordSize + static_cast<uint64_t>(name_count) * kNameRecordSize) {
+        return false;
+    }
+
+    mapping_ = std::move(mapping);
+    point_count_ = point_count;
+    name_count_ = name_count;
+    points_ = from.substr(0, point_count * kPointRecordSize);
+    names_ = from.substr(points_.size(), name_count * kNameRecordSize);
+    pool_ = from.substr(points_.size() + names_.size());
+
+    return true;
+}
+
+std::optional<std::string> StationDirectory::FindCode(std::string_view title) const {
+    uint32_t first = 0;
+    uint32_t count = name_count_;
+
+    // Lower bound of the title
+    while (count > 0) {
+        uint32_t step = count / 2;
+
+        if (GetString(GetNameRecord(first + step).title) < title) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+
+    size_t matches = 0;
+    size_t settlements = 0;
+    uint32_t point = 0;
+    uint32_t settlement = 0;
+
+    for (uint32_t i = first; i < name_count_; ++i) {
+        NameRecord name = GetNameRecord(i);
+
+        if (GetString(name.title) != title || name.point >= point_count_) {
+            break;
+        }
+
+        ++matches;
+        point = name.point;
+
+        if (GetString(GetPointRecord(name.point).type) == "settlement") {
+            ++settlements;
+            settlement = name.point;
+        }
+    }
+
+    if (matches != 1 && settlements != 1) {
+        return std::nullopt;
+    }
+
+    uint32_t found = matches == 1 ? point : settlement;
+
+    return std::string{GetString(GetPointRecord(found).code)};
+}
+
+void StationDirectory::ForEachPoint(const std::function<void(const RoutePoint&)>& visit) const {
+    for (uint32_t i = 0; i < point_count_; ++i) {
+        visit(GetPoint(GetPointRecord(i)));
+    }
+}
+
+size_t StationDirectory::GetSize() const {
+    return point_count_;
+}
+
+StationDirectory::PointRecord StationDirectory::GetPointRecord(uint32_t index) const {
+    std::string_view from = points_.substr(index * kPointRecordSize);
+    PointRecord record;
+
+    ReadBinary(from, record.code);
+    ReadBinary(from, record.title);
+    ReadBinary(from, record.type);
+    ReadBinary(from, record.station_type);
+
+    return record;
+}
+
+RoutePoint StationDirectory::GetPoint(const PointRecord& record) const {
+    return RoutePoint{
+        std::string{GetString(record.code)},
+        std::string{GetString(record.type)},
+        std::string{GetString(record.title)},
+        std::string{GetString(record.station_type)}
+    };
+}
+
+StationDirectory::NameRecord StationDirectory::GetNameRecord(uint32_t index) const {
+    std::string_view from = names_.substr(index * kNameRecordSize);
+    NameRecord record;
+
+    ReadBinary(from, record.title);
+    ReadBinary(from, record.point);
+
+    return record;
+}
+
+std::string_view StationDirectory::GetString(uint32_t offset) const {
+    if (offset >= pool_.size()) {
+        return {};
+    }
+
+    std::string_view from = pool_.substr(offset);
+    uint32_t size;
+
+    if (!ReadBinary(from, size) || from.size() < size) {
+        return {};
+    }
+
+    return from.substr(0, size);
+}
+
+} // namespace WayHome
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Route.hpp"
+#include "CacheStore.hpp" // for SegmentMapping
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <expected>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+namespace WayHome {
+
+const std::string kStationDirectoryFilename = "wayhome_stations.bin";
+
+// Offline directory of all settlements and stations, built once from a stations_list export
+// (https://yandex.ru/dev/rasp/doc/ru/reference/stations-list), so names are resolved without the API.
+//
+// The file is mapped into memory as is. After the header it holds the points sorted by code,
+// then (title, point) pairs sorted by title, both as fixed-size records referring to a pool
+// of deduplicated strings. Lookups are binary searches over the mapping.
+class StationDirectory {
+public:
+    // Converts the stations_list JSON into a directory file, returns the number of points
+    static std::expected<size_t, Error> Import(const std::string& stations_list_path, const std::string& path);
+
+    // A missing or malformed file leaves the directory empty
+    bool Open(const std::string& path);
+
+    // Code of the point with this title. If several points share it, the settlement among them
+    // is preferred; titles that stay ambiguous are not resolved.
+    std::optional<std::string> FindCode(std::string_view title) const;
+    void ForEachPoint(const std::function<void(const RoutePoint&)>& visit) const;
+
+    size_t GetSize() const;
+
+private:
+    struct PointRecord {
+        uint32_t code;
+        uint32_t title;
+        uint32_t type;
+        uint32_t station_type;
+    };
+
+    struct NameRecord {
+        uint32_t title;
+        uint32_t point;
+    };
+
+    std::shared_ptr<const SegmentMapping> mapping_;
+
+    uint32_t point_count_ = 0;
+    uint32_t name_count_ = 0;
+    std::string_view points_;
+    std::string_view names_;
+    std::string_view pool_;
+
+    PointRecord GetPointRecord(uint32_t index) const;
+    RoutePoint GetPoint(const PointRecord& record) const;
+    NameRecord GetNameRecord(uint32_t index) const;
+    // Empty for offsets outside the pool, the file is not trusted
+    std::string_view GetString(uint32_t offset) const;
+};
+
+} // namespace WayHome
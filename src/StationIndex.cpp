@@ -0,0 +1,111 @@
+#include "StationIndex.hpp"
+#include "CacheKey.hpp"
+
+#include <fstream>
+
+namespace WayHome {
+
+namespace {
+
+// Codes were kept as a single JSON object: first in this file of the working directory,
+// then under the same name as an entry of the codes store, before they were stored one per record
+const std::string kLegacyCodesFilename = "wayhome_codes.json";
+
+} // namespace
+
+StationIndex::StationIndex(const std::string& cache_dir)
+    : cache_handler_(cache_dir, 0) {
+    // Expired failures and superseded records are dropped in the background
+    cache_handler_.ClearExpiredCache(kCacheStartupSweepBudget);
+}
+
+std::optional<std::string> StationIndex::Find(const std::string& name) const {
+    std::optional<std::string> code = FindLoaded(name);
+
+    if (code.has_value()) {
+        return code;
+    }
+
+    std::string stored_code;
+
+    if (!cache_handler_.LoadCacheBinary(stored_code, MakeStationCacheKey(name))) {
+        return FindLegacy(name);
+    }
+
+    std::unique_lock lock{mutex_};
+    codes_.insert_or_assign(name, stored_code);
+
+    return stored_code;
+}
+
+bool StationIndex::Add(const std::string& name, const std::string& code) {
+    if (!cache_handler_.UpdateCacheBinary(code, MakeStationCacheKey(name))) {
+        return false;
+    }
+
+    std::unique_lock lock{mutex_};
+    codes_.insert_or_assign(name, code);
+
+    return true;
+}
+
+size_t StationIndex::GetSize() const {
+    std::shared_lock lock{mutex_};
+    return codes_.size();
+}
+
+std::optional<std::string> StationIndex::FindLoaded(const std::string& name) const {
+    std::shared_lock lock{mutex_};
+    auto it = codes_.find(name);
+
+    if (it == codes_.end()) {
+        return std::nullopt;
+    }
+
+    return it->second;
+}
+
+std::optional<std::string> StationIndex::FindLegacy(const std::string& name) const {
+    std::call_once(legacy_once_, &StationIndex::LoadLegacy, this);
+
+    auto it = legacy_codes_.find(name);
+
+    if (it == legacy_codes_.end()) {
+        return std::nullopt;
+    }
+
+    std::unique_lock lock{mutex_};
+    codes_.insert_or_assign(name, it->second);
+
+    return it->second;
+}
+
+void StationIndex::LoadLegacy() const {
+    json store_obj;
+    json file_obj;
+
+    if (!cache_handler_.LoadCache(store_obj, kLegacyCodesFilename)) {
+        store_obj = json::object();
+    }
+
+    std::ifstream file{kLegacyCodesFilename};
+
+    if (file.good()) {
+        file_obj = json::parse(file, nullptr, false);
+    }
+
+    // The store entry was written after the file, so its codes win
+    for (const json* legacy_obj : {&store_obj, &file_obj}) {
+        if (!legacy_obj->is_object()) {
+            continue;
+        }
+
+        for (const auto& [name, code] : legacy_obj->items()) {
+            if (code.is_string()) {
+                legacy_codes_.emplace(name, code.get<std::string>());
+            }
+        }
+    }
+}
+
+} // namespace WayHome
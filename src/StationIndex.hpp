@@ -0,0 +1,44 @@
+#pragma once
+
+#include "CacheHandler.hpp"
+
+#include <string>
+#include <optional>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+
+namespace WayHome {
+
+// Names resolved to station and settlement codes.
+//
+// Every name is a separate record of the codes store, so saving a name appends one record
+// instead of rewriting all of them, and the superseded records are dropped by the store's compaction.
+// Names looked up once are kept in a hash map, later lookups don't touch the store.
+// Codes saved by older versions as a single JSON object, either the wayhome_codes.json file
+// of the working directory or the entry of the same name in the codes store, are read once, when a name is missed.
+// Lookups and additions may come from several threads.
+class StationIndex {
+public:
+    explicit StationIndex(const std::string& cache_dir);
+
+    std::optional<std::string> Find(const std::string& name) const;
+    bool Add(const std::string& name, const std::string& code);
+
+    size_t GetSize() const;
+
+private:
+    CacheHandler cache_handler_;
+
+    mutable std::unordered_map<std::string, std::string> codes_;
+    mutable std::shared_mutex mutex_;
+    mutable std::once_flag legacy_once_;
+    // Written once under legacy_once_, read-only afterwards. Asked only when a name has no record of its own.
+    mutable std::unordered_map<std::string, std::string> legacy_codes_;
+
+    std::optional<std::string> FindLoaded(const std::string& name) const;
+    std::optional<std::string> FindLegacy(const std::string& name) const;
+    void LoadLegacy() const;
+};
+
+} // namespace WayHome
@@ -0,0 +1,274 @@
+#include "StationMatcher.hpp"
+
+#include <algorithm>
+
+namespace WayHome {
+
+namespace {
+
+// Bytes of invalid sequences are taken as Latin-1 characters, so any input can be folded
+std::u32string DecodeUtf8(std::string_view text) {
+    std::u32string decoded;
+    decoded.reserve(text.size());
+
+    for (size_t i = 0; i < text.size();) {
+        uint8_t lead = text[i];
+        size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+
+        if (length <= 1 || i + length > text.size()) {
+            decoded.push_back(lead);
+            ++i;
+            continue;
+        }
+
+        char32_t codepoint = lead & (0x7F >> length);
+        bool is_valid = true;
+
+        for (size_t j = 1; j < length; ++j) {
+            uint8_t next = text[i + j];
+            is_valid = is_valid && (next >> 6) == 0x2;
+            codepoint = (codepoint << 6) | (next & 0x3F);
+        }
+
+        if (!is_valid) {
+            decoded.push_back(lead);
+            ++i;
+            continue;
+        }
+
+        decoded.push_back(codepoint);
+        i += length;
+    }
+
+    return decoded;
+}
+
+void AppendUtf8(std::string& to, char32_t codepoint) {
+    if (codepoint < 0x80) {
+        to.push_back(static_cast<char>(codepoint));
+    } else if (codepoint < 0x800) {
+        to.push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+        to.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else if (codepoint < 0x10000) {
+        to.push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+        to.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        to.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else {
+        to.push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+        to.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+        to.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        to.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+}
+
+char32_t FoldCodepoint(char32_t codepoint) {
+    if (codepoint >= U'A' && codepoint <= U'Z') {
+        return codepoint + 0x20;
+    }
+
+    if (codepoint >= U'А' && codepoint <= U'Я') {
+        return codepoint + 0x20;
+    }
+
+    // Ѐ..Џ
+    if (codepoint >= 0x400 && codepoint <= 0x40F) {
+        codepoint += 0x50;
+    }
+
+    // ё is often written as е
+    if (codepoint == U'ё') {
+        return U'е';
+    }
+
+    return codepoint;
+}
+
+bool IsSpace(char32_t codepoint) {
+    return codepoint == U' ' || codepoint == U'\t' || codepoint == U'\n' || codepoint == U'\r' || codepoint == 0xA0;
+}
+
+// Codepoints are below 2^21, three of them fit into a key
+std::vector<uint64_t> GetTrigrams(std::string_view folded) {
+    std::u32string padded = U"  " + DecodeUtf8(folded) + U" ";
+    std::vector<uint64_t> trigrams;
+
+    for (size_t i = 0; i + 3 <= padded.size(); ++i) {
+        trigrams.push_back((uint64_t{padded[i]} << 42) | (uint64_t{padded[i + 1]} << 21) | padded[i + 2]);
+    }
+
+    std::ranges::sort(trigrams);
+    trigrams.erase(std::ranges::unique(trigrams).begin(), trigrams.end());
+
+    return trigrams;
+}
+
+bool IsRankedHigher(const StationCandidate& lhs, const StationCandidate& rhs) {
+    if (lhs.kind != rhs.kind) {
+        return lhs.kind < rhs.kind;
+    }
+
+    if (lhs.score != rhs.score) {
+        return lhs.score > rhs.score;
+    }
+
+    bool is_lhs_settlement = lhs.point.type == "settlement";
+    bool is_rhs_settlement = rhs.point.type == "settlement";
+
+    if (is_lhs_settlement != is_rhs_settlement) {
+        return is_lhs_settlement;
+    }
+
+    return lhs.point.title < rhs.point.title;
+}
+
+} // namespace
+
+std::string FoldCase(std::string_view text) {
+    std::string folded;
+    folded.reserve(text.size());
+
+    bool is_after_space = true;
+
+    for (char32_t codepoint : DecodeUtf8(text)) {
+        if (IsSpace(codepoint)) {
+            is_after_space = true;
+            continue;
+        }
+
+        if (is_after_space && !folded.empty()) {
+            folded.push_back(' ');
+        }
+
+        is_after_space = false;
+        AppendUtf8(folded, FoldCodepoint(codepoint));
+    }
+
+    return folded;
+}
+
+void StationMatcher::Add(const RoutePoint& point) {
+    entries_.push_back({FoldCase(point.title), point});
+}
+
+void StationMatcher::Build() {
+    std::ranges::sort(entries_, {}, &Entry::folded);
+    trigrams_.clear();
+
+    for (uint32_t i = 0; i < entries_.size(); ++i) {
+        std::vector<uint64_t> trigrams = GetTrigrams(entries_[i].folded);
+        entries_[i].trigram_count = trigrams.size();
+
+        for (uint64_t trigram : trigrams) {
+            trigrams_[trigram].push_back(i);
+        }
+    }
+}
+
+std::vector<StationCandidate> StationMatcher::Match(std::string_view input, size_t limit) const {
+    std::string folded = FoldCase(input);
+    std::vector<StationCandidate> candidates;
+
+    if (folded.empty() || limit == 0) {
+        return candidates;
+    }
+
+    auto [first, last] = FindPrefix(folded);
+
+    for (size_t i = first; i < last; ++i) {
+        const Entry& entry = entries_[i];
+        bool is_exact = entry.folded.size() == folded.size();
+
+        candidates.push_back({
+            entry.point,
+            is_exact ? MatchKind::kExact : MatchKind::kPrefix,
+            static_cast<double>(folded.size()) / entry.folded.size()
+        });
+    }
+
+    // Shared trigrams are counted only for the entries having any
+    std::vector<uint64_t> trigrams = GetTrigrams(folded);
+    std::unordered_map<uint32_t, uint32_t> shared;
+
+    for (uint64_t trigram : trigrams) {
+        auto it = trigrams_.find(trigram);
+
+        if (it == trigrams_.end()) {
+            continue;
+        }
+
+        for (uint32_t index : it->second) {
+            ++shared[index];
+        }
+    }
+
+    for (auto [index, count] : shared) {
+        if (index >= first && index < last) {
+            continue;
+        }
+
+        double similarity = static_cast<double>(count) / (trigrams.size() + entries_[index].trigram_count - count);
+
+        if (similarity >= kStationMatchMinSimilarity) {
+            candidates.push_back({entries_[index].point, MatchKind::kFuzzy, similarity});
+        }
+    }
+
+    size_t count = std::min(limit, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), IsRankedHigher);
+    candidates.resize(count);
+
+    return candidates;
+}
+
+std::optional<std::string> StationMatcher::FindCode(std::string_view input) const {
+    std::string folded = FoldCase(input);
+    auto [first, last] = FindPrefix(folded);
+
+    size_t matches = 0;
+    size_t settlements = 0;
+    const RoutePoint* point = nullptr;
+    const RoutePoint* settlement = nullptr;
+
+    for (size_t i = first; i < last; ++i) {
+        if (entries_[i].folded.size() != folded.size()) {
+            continue;
+        }
+
+        ++matches;
+        point = &entries_[i].point;
+
+        if (point->type == "settlement") {
+            ++settlements;
+            settlement = point;
+        }
+    }
+
+    if (matches == 1) {
+        return point->code;
+    }
+
+    if (settlements == 1) {
+        return settlement->code;
+    }
+
+    return std::nullopt;
+}
+
+size_t StationMatcher::GetSize() const {
+    return entries_.size();
+}
+
+std::pair<size_t, size_t> StationMatcher::FindPrefix(std::string_view prefix) const {
+    auto first = std::ranges::lower_bound(entries_, prefix, {}, [](const Entry& entry) -> std::string_view {
+        return entry.folded;
+    });
+
+    // Titles starting with the prefix follow its lower bound
+    auto last = std::partition_point(first, entries_.end(), [prefix](const Entry& entry) {
+        return entry.folded.starts_with(prefix);
+    });
+
+    return {first - entries_.begin(), last - entries_.begin()};
+}
+
+} // namespace WayHome
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "Route.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+namespace WayHome {
+
+const size_t kStationMatchDefaultLimit = 10;
+// Share of trigrams a fuzzy candidate has in common with the input
+const double kStationMatchMinSimilarity = 0.3;
+
+// Lower case for Latin and Cyrillic letters with ё taken as е, whitespace runs are collapsed into one space
+std::string FoldCase(std::string_view text);
+
+enum class MatchKind {
+    kExact,
+    kPrefix,
+    kFuzzy
+};
+
+struct StationCandidate {
+    RoutePoint point;
+    MatchKind kind;
+    // 1 for exact matches, the share of the title or of the trigrams matched otherwise
+    double score;
+};
+
+// Approximate lookup of station and settlement titles.
+// Titles are compared after FoldCase. Prefix matches are found by a binary search over the sorted titles,
+// fuzzy ones by the trigrams they share with the input. Read-only after Build, so lookups may run concurrently.
+class StationMatcher {
+public:
+    void Add(const RoutePoint& point);
+    void Build();
+
+    // Exact matches go first, then prefix and fuzzy matches, each ordered by score.
+    // Settlements are ranked above stations with the same score.
+    std::vector<StationCandidate> Match(std::string_view input, size_t limit = kStationMatchDefaultLimit) const;
+    // Code of the only point with the same title up to case, the settlement is preferred among several
+    std::optional<std::string> FindCode(std::string_view input) const;
+
+    size_t GetSize() const;
+
+private:
+    struct Entry {
+        std::string folded;
+        RoutePoint point;
+        uint32_t trigram_count = 0;
+    };
+
+    // Sorted by the folded title after Build
+    std::vector<Entry> entries_;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> trigrams_;
+
+    // Range of the entries starting with `prefix`
+    std::pair<size_t, size_t> FindPrefix(std::string_view prefix) const;
+};
+
+} // namespace WayHome
@@ -0,0 +1,129 @@
+#include "TtlPolicy.hpp"
+#include "Date.hpp"
+
+#include <algorithm>
+#include <optional>
+
+namespace WayHome {
+
+namespace {
+
+bool ReadSeconds(const json& obj, const std::string& name, uint32_t& to) {
+    if (!obj.contains(name)) {
+        return true;
+    }
+
+    if (!obj[name].is_number_unsigned()) {
+        return false;
+    }
+
+    to = obj[name];
+    return true;
+}
+
+} // namespace
+
+uint32_t TtlPolicy::GetTtlSeconds(const std::string& date,
+                                  const std::string& transport_type,
+                                  ResponseKind kind,
+                                  std::chrono::system_clock::time_point now) const {
+    if (kind == ResponseKind::kFailed) {
+        return failed_seconds_;
+    }
+
+    std::optional<std::chrono::sys_days> departure_day = ParseDate(date);
+    uint32_t ttl = far_seconds_;
+    bool is_past = false;
+
+    if (departure_day.has_value()) {
+        auto days_left = (departure_day.value() - GetApiDay(now)).count();
+
+        if (days_left < 0) {
+            ttl = past_seconds_;
+            is_past = true;
+        } else if (days_left == 0) {
+            ttl = today_seconds_;
+        } else {
+            // An entry must not outlive its bucket: a far date turns near, a near date becomes today
+            std::chrono::sys_days bucket_end = departure_day.value();
+
+            if (days_left <= near_days_) {
+                ttl = near_seconds_;
+            } else {
+                bucket_end -= std::chrono::days{near_days_};
+            }
+
+            auto seconds_left = std::chrono::ceil<std::chrono::seconds>(GetApiDayStart(bucket_end) - now).count();
+            ttl = static_cast<uint32_t>(std::clamp<int64_t>(seconds_left, 1, ttl));
+        }
+    }
+
+    auto transport_it = transport_max_seconds_.find(transport_type);
+
+    if (!is_past && transport_it != transport_max_seconds_.end()) {
+        ttl = std::min(ttl, transport_it->second);
+    }
+
+    if (kind == ResponseKind::kPartial) {
+        ttl = std::min(ttl, partial_seconds_);
+    }
+
+    return ttl;
+}
+
+uint32_t TtlPolicy::GetFailedTtlSeconds() const {
+    return failed_seconds_;
+}
+
+bool TtlPolicy::LoadFromJson(const json& obj) {
+    if (!obj.is_object()) {
+        return false;
+    }
+
+    if (!ReadSeconds(obj, "past_seconds", past_seconds_)
+    || !ReadSeconds(obj, "today_seconds", today_seconds_)
+    || !ReadSeconds(obj, "near_seconds", near_seconds_)
+    || !ReadSeconds(obj, "far_seconds", far_seconds_)
+    || !ReadSeconds(obj, "near_days", near_days_)
+    || !ReadSeconds(obj, "partial_seconds", partial_seconds_)
+    || !ReadSeconds(obj, "failed_seconds", failed_seconds_)) {
+        return false;
+    }
+
+    if (!obj.contains("transport_max_seconds")) {
+        return true;
+    }
+
+    const json& transport_obj = obj["transport_max_seconds"];
+
+    if (!transport_obj.is_object()) {
+        return false;
+    }
+
+    transport_max_seconds_.clear();
+
+    for (const auto& [transport_type, seconds] : transport_obj.items()) {
+        if (!seconds.is_number_unsigned()) {
+            return false;
+        }
+
+        transport_max_seconds_[transport_type] = seconds;
+    }
+
+    return true;
+}
+
+json TtlPolicy::ToJson() const {
+    return {
+        {"past_seconds", past_seconds_},
+        {"today_seconds", today_seconds_},
+        {"near_seconds", near_seconds_},
+        {"far_seconds", far_seconds_},
+        {"near_days", near_days_},
+        {"partial_seconds", partial_seconds_},
+        {"failed_seconds", failed_seconds_},
+        {"transport_max_seconds", transport_max_seconds_}
+    };
+}
+
+} // namespace WayHome
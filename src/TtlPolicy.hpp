@@ -0,0 +1,49 @@
+#pragma once
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+#include <string>
+#include <map>
+#include <chrono>
+#include <cstdint>
+
+namespace WayHome {
+
+enum class ResponseKind {
+    kComplete,
+    kPartial,
+    kFailed
+};
+
+// Computes the lifetime of a route cache entry.
+// Schedules for past dates don't change, the closer the date is the more volatile the schedule gets.
+// Configured by the "cache_ttl" object in the settings file, missing fields keep the defaults.
+class TtlPolicy {
+public:
+    uint32_t GetTtlSeconds(const std::string& date,
+                           const std::string& transport_type,
+                           ResponseKind kind,
+                           std::chrono::system_clock::time_point now = std::chrono::system_clock::now()) const;
+
+    // Lifetime of remembered failures: names not found, searches rejected by the API
+    uint32_t GetFailedTtlSeconds() const;
+
+    bool LoadFromJson(const json& obj);
+    json ToJson() const;
+
+private:
+    uint32_t past_seconds_ = 365 * 24 * 60 * 60;
+    uint32_t today_seconds_ = 60 * 60;
+    uint32_t near_seconds_ = 6 * 60 * 60;
+    uint32_t far_seconds_ = 7 * 24 * 60 * 60;
+    uint32_t near_days_ = 3;
+
+    uint32_t partial_seconds_ = 60 * 60;
+    uint32_t failed_seconds_ = 5 * 60;
+
+    // Upper bounds for schedules of particular transport types, past dates excluded
+    std::map<std::string, uint32_t> transport_max_seconds_{{"plane", 24 * 60 * 60}};
+};
+
+} // namespace WayHome
@@ -1,4 +1,5 @@
 #include "WayHome.hpp"
+#include "Metrics.hpp"
 
 #include <argparser/ArgParser.hpp>
 
@@ -9,22 +10,102 @@ using json = nlohmann::json;
 #include <format>
 #include <filesystem>
 #include <iostream>
+#include <future>
+#include <atomic>
+#include <algorithm>
 
 namespace WayHome {
 
-WayHome::WayHome(const std::string& apikey, const ApiRouteParameters& parameters) : parameters_(parameters) {
+namespace {
+
+ResponseKind GetResponseKind(const json& response_obj) {
+    if (!response_obj.contains("pagination") || !response_obj.contains("segments")) {
+        return ResponseKind::kComplete;
+    }
+
+    // Nothing found is remembered as briefly as a failure
+    if (response_obj["segments"].empty()) {
+        return ResponseKind::kFailed;
+    }
+
+    const json& pagination_obj = response_obj["pagination"];
+
+    if (pagination_obj.contains("total") && pagination_obj["total"].is_number_unsigned()
+    && pagination_obj["total"].get<size_t>() > response_obj["segments"].size()) {
+        return ResponseKind::kPartial;
+    }
+
+    return ResponseKind::kComplete;
+}
+
+bool ParseCacheLimits(const json& obj, CacheLimits& limits) {
+    if (!obj.is_object()) {
+        return false;
+    }
+
+    if (obj.contains("max_bytes")) {
+        if (!obj["max_bytes"].is_number_unsigned()) {
+            return false;
+        }
+
+        limits.max_bytes = obj["max_bytes"];
+    }
+
+    if (obj.contains("max_entries")) {
+        if (!obj["max_entries"].is_number_unsigned()) {
+            return false;
+        }
+
+        limits.max_entries = obj["max_entries"];
+    }
+
+    if (obj.contains("eviction")) {
+        if (obj["eviction"] == "lru") {
+            limits.eviction_policy = EvictionPolicy::kLru;
+        } else if (obj["eviction"] == "lfu") {
+            limits.eviction_policy = EvictionPolicy::kLfu;
+        } else {
+            return false;
+        }
+    }
+
+    if (obj.contains("compression")) {
+        if (!obj["compression"].is_boolean()) {
+            return false;
+        }
+
+        limits.compression = obj["compression"];
+    }
+
+    return true;
+}
+
+} // namespace
+
+WayHome::WayHome(const std::string& apikey, const ApiRouteParameters& parameters, const CacheOptions& options)
+    : parameters_(CanonicalizeRouteParameters(parameters))
+    , options_(options) {
+    cache_.SetExpiryGrace(std::max(options_.max_stale, options_.stale_if_error));
+    code_searcher_.SetFailureCaching(ttl_policy_.GetFailedTtlSeconds(), options_.retry_failed);
     SetCodeForEndpoints();
 
     if (!HasError()) {
         api_ = std::make_unique<ApiHandler>(apikey_, parameters_);
 
-        if (!cache_.ClearExpiredCache()) {
+        // Routes cached before the store are read as JSON and upgraded by LoadRoutesFromCache
+        cache_.ImportLegacyFiles(MakeRoutesCacheKeyFromLegacyFilename);
+
+        if (!cache_.ClearExpiredCache(kCacheStartupSweepBudget)) {
             error_ = {"Unable to clear expired cache", ErrorType::kEnvironmentError};
         }
     }
 }
 
-WayHome::WayHome(const ApiRouteParameters& parameters) : parameters_(parameters) {
+WayHome::WayHome(const ApiRouteParameters& parameters, const CacheOptions& options)
+    : parameters_(CanonicalizeRouteParameters(parameters))
+    , options_(options) {
+    cache_.SetExpiryGrace(std::max(options_.max_stale, options_.stale_if_error));
+
     if (!std::filesystem::exists(kSettingsFilename)) {
         CreateSettingsFile();
         if (!HasError()) {
@@ -35,17 +116,31 @@ WayHome::WayHome(const ApiRouteParameters& parameters) : parameters_(parameters)
     }
 
     ReadSettings();
+    code_searcher_.SetFailureCaching(ttl_policy_.GetFailedTtlSeconds(), options_.retry_failed);
     SetCodeForEndpoints();
 
     if (!HasError()) {
         api_ = std::make_unique<ApiHandler>(apikey_, parameters_);
 
-        if (!cache_.ClearExpiredCache()) {
+        // Routes cached before the store are read as JSON and upgraded by LoadRoutesFromCache
+        cache_.ImportLegacyFiles(MakeRoutesCacheKeyFromLegacyFilename);
+
+        if (!cache_.ClearExpiredCache(kCacheStartupSweepBudget)) {
             error_ = {"Unable to clear expired cache", ErrorType::kEnvironmentError};
         }
     }
 }
 
+WayHome::WayHome(const WayHome& parent, const std::string& date)
+    : ttl_policy_(parent.ttl_policy_)
+    , parameters_(parent.parameters_)
+    , options_(parent.options_)
+    , apikey_(parent.apikey_)
+    , request_budget_(parent.request_budget_) {
+    parameters_.date = date;
+    api_ = std::make_unique<ApiHandler>(apikey_, parameters_);
+}
+
 void WayHome::ReadSettings() {
     std::ifstream f(kSettingsFilename);
 
@@ -63,13 +158,70 @@ void WayHome::ReadSettings() {
     }
 
     apikey_ = std::move(settings_obj["apikey"]);
+
+    if (settings_obj.contains("cache_ttl") && !ttl_policy_.LoadFromJson(settings_obj["cache_ttl"])) {
+        error_ = {"Invalid \"cache_ttl\" in " + kSettingsFilename, ErrorType::kEnvironmentError};
+    }
+
+    if (settings_obj.contains("cache")) {
+        CacheLimits limits;
+
+        if (ParseCacheLimits(settings_obj["cache"], limits)) {
+            cache_.SetLimits(limits);
+        } else {
+            error_ = {"Invalid \"cache\" in " + kSettingsFilename, ErrorType::kEnvironmentError};
+        }
+    }
+
+    if (settings_obj.contains("quota")) {
+        QuotaLimits limits;
+
+        if (ParseQuotaLimits(settings_obj["quota"], limits)) {
+            GetApiQuota().SetLimits(limits);
+        } else {
+            error_ = {"Invalid \"quota\" in " + kSettingsFilename, ErrorType::kEnvironmentError};
+        }
+    }
+
+    if (settings_obj.contains("retry")) {
+        RetryPolicy policy;
+
+        if (ParseRetryPolicy(settings_obj["retry"], policy)) {
+            GetApiResilience().SetPolicy(policy);
+        } else {
+            error_ = {"Invalid \"retry\" in " + kSettingsFilename, ErrorType::kEnvironmentError};
+        }
+    }
+
+    if (settings_obj.contains("http")) {
+        SessionPoolOptions options;
+
+        if (ParseSessionPoolOptions(settings_obj["http"], options)) {
+            GetSessionPool().Configure(options);
+        } else {
+            error_ = {"Invalid \"http\" in " + kSettingsFilename, ErrorType::kEnvironmentError};
+        }
+    }
 }
 
 void WayHome::CreateSettingsFile() const {
     std::ofstream f(kSettingsFilename);
 
     json settings_obj{
-        {"apikey", ""}
+        {"apikey", ""},
+        {"cache_ttl", TtlPolicy{}.ToJson()},
+        {"cache", {
+            {"max_bytes", CacheLimits{}.max_bytes},
+            {"max_entries", CacheLimits{}.max_entries},
+            {"eviction", "lru"},
+            {"compression", CacheLimits{}.compression}
+        }},
+        {"http", {
+            {"pool_size", SessionPoolOptions{}.max_idle},
+            {"http2", SessionPoolOptions{}.http2},
+            {"compression", SessionPoolOptions{}.compression},
+            {"dns_cache_seconds", SessionPoolOptions{}.dns_cache_ttl.count()}
+        }}
     };
 
     if (!f.good()) {
@@ -85,34 +237,36 @@ bool WayHome::SetCodeForEndpoints() {
         return false;
     }
 
-    if (!parameters_.from.starts_with('c') && !parameters_.from.starts_with('s')) {
-        std::expected<std::string, Error> search_result = code_searcher_.FindCode(parameters_.from);
+    auto find_code = [this](const std::string& point) -> std::expected<std::string, Error> {
+        if (IsPointCode(point)) {
+            return point;
+        }
 
-        if (!search_result.has_value()) {
-            search_result.error().message 
-                = std::format("Could not find a code for {}; {}", parameters_.from, search_result.error().message);
+        return code_searcher_.FindCode(point);
+    };
 
-            error_ = search_result.error();
-            return false;
-        }
+    // Each name may cost a suggests request, two of them are looked up at the same time
+    bool are_both_names = !IsPointCode(parameters_.from) && !IsPointCode(parameters_.to);
+    std::future<std::expected<std::string, Error>> from_search
+        = std::async(are_both_names ? std::launch::async : std::launch::deferred, find_code, parameters_.from);
 
-        std::cout << "Found code for " + parameters_.from + ": " + search_result.value() << std::endl;
-        parameters_.from = search_result.value();
-    }
+    std::expected<std::string, Error> to_result = find_code(parameters_.to);
+    std::expected<std::string, Error> from_result = from_search.get();
 
-    if (!parameters_.to.starts_with('c') && !parameters_.to.starts_with('s')) {
-        std::expected<std::string, Error> search_result = code_searcher_.FindCode(parameters_.to);
+    return SetEndpointCode(parameters_.from, from_result) && SetEndpointCode(parameters_.to, to_result);
+}
 
-        if (!search_result.has_value()) {
-            search_result.error().message 
-                = std::format("Could not find a code for {}; {}", parameters_.to, search_result.error().message);
+bool WayHome::SetEndpointCode(std::string& point, const std::expected<std::string, Error>& search_result) {
+    if (!search_result.has_value()) {
+        error_ = search_result.error();
+        error_.message = std::format("Could not find a code for {}; {}", point, search_result.error().message);
 
-            error_ = search_result.error();
-            return false;
-        }
+        return false;
+    }
 
-        std::cout << "Found code for " + parameters_.to + ": " + search_result.value() << std::endl;
-        parameters_.to = search_result.value();
+    if (point != search_result.value()) {
+        std::cout << "Found code for " + point + ": " + search_result.value() << std::endl;
+        point = search_result.value();
     }
 
     return true;
@@ -125,11 +279,145 @@ void WayHome::CalculateRoutes() {
 
     std::string cache_filename = GetCacheFilename();
 
-    if (!cache_.IsCacheExpired(cache_filename) && LoadRoutesFromCache(cache_filename)) {
+    if (GetMemoryCache().Get(routes_, cache_filename)) {
+        return;
+    }
+
+    std::optional<std::chrono::system_clock::time_point> expiration_time = cache_.GetExpirationTime(cache_filename);
+    auto now = std::chrono::system_clock::now();
+    bool is_fresh = expiration_time.has_value() && now < expiration_time.value();
+
+    // Expired entries are misses as well, counted apart to tell why
+    GetMetrics().Increment(is_fresh ? Counter::kCacheHits : Counter::kCacheMisses);
+
+    if (expiration_time.has_value() && !is_fresh) {
+        GetMetrics().Increment(Counter::kCacheExpired);
+    }
+
+    if (is_fresh && LoadRoutesFromCache(cache_filename)) {
+        return;
+    }
+
+    // Slightly outdated schedules are answered right away, the API is asked after them
+    if (expiration_time.has_value() && now >= expiration_time.value()
+    && now - expiration_time.value() <= options_.max_stale && LoadRoutesFromCache(cache_filename)) {
+        staleness_ = std::chrono::duration_cast<std::chrono::seconds>(now - expiration_time.value());
+        RefreshInBackground(cache_filename);
+        return;
+    }
+
+    if (!options_.retry_failed && LoadFailureFromCache(cache_filename)) {
+        return;
+    }
+
+    UpdateRoutesWithAPI(true);
+
+    if (HasError()) {
+        FallBackToStaleCache(cache_filename, expiration_time);
+    }
+}
+
+bool WayHome::FallBackToStaleCache(const std::string& filename,
+                                   const std::optional<std::chrono::system_clock::time_point>& expiration_time) {
+    auto now = std::chrono::system_clock::now();
+
+    // Rejected parameters are not the API being down
+    if (error_.type == ErrorType::kParametersError || !expiration_time.has_value()
+    || now - expiration_time.value() > options_.stale_if_error) {
+        return false;
+    }
+
+    Error api_error = error_;
+    error_ = {};
+
+    if (!LoadRoutesFromCache(filename)) {
+        error_ = api_error;
+        return false;
+    }
+
+    staleness_ = std::chrono::duration_cast<std::chrono::seconds>(now - expiration_time.value());
+    api_error_ = std::move(api_error);
+
+    return true;
+}
+
+void WayHome::CalculateRoutes(const std::vector<std::string>& dates, bool update_cache) {
+    if (HasError()) {
         return;
     }
 
-    UpdateRoutesWithAPI();
+    date_searches_.clear();
+    failed_dates_.clear();
+
+    for (const std::string& date : dates) {
+        // The constructor is private, so std::make_unique can't call it
+        date_searches_.emplace_back(new WayHome{*this, date});
+    }
+
+    std::atomic<size_t> next = 0;
+
+    auto work = [&] {
+        for (size_t i = next++; i < date_searches_.size(); i = next++) {
+            if (update_cache) {
+                date_searches_[i]->UpdateRoutesWithAPI();
+            } else {
+                date_searches_[i]->CalculateRoutes();
+            }
+        }
+    };
+
+    std::vector<std::jthread> workers;
+
+    for (size_t i = 0; i < std::min(kDateSearchJobs, date_searches_.size()); ++i) {
+        workers.emplace_back(work);
+    }
+
+    workers.clear();
+
+    routes_.Clear();
+    staleness_.reset();
+    api_error_.reset();
+
+    for (const std::unique_ptr<WayHome>& search : date_searches_) {
+        if (search->HasError()) {
+            failed_dates_.emplace_back(search->parameters_.date, search->GetError());
+            continue;
+        }
+
+        routes_.Merge(search->routes_);
+
+        if (search->staleness_.has_value()) {
+            staleness_ = std::max(staleness_.value_or(std::chrono::seconds{0}), search->staleness_.value());
+        }
+
+        if (search->api_error_.has_value() && !api_error_.has_value()) {
+            api_error_ = search->api_error_;
+        }
+    }
+
+    if (!failed_dates_.empty() && failed_dates_.size() == date_searches_.size()) {
+        error_ = failed_dates_.front().second;
+    }
+}
+
+CacheState WayHome::GetCacheState() const {
+    std::string cache_filename = GetCacheFilename();
+    std::optional<std::chrono::system_clock::time_point> expiration_time = cache_.GetExpirationTime(cache_filename);
+    auto now = std::chrono::system_clock::now();
+
+    if (expiration_time.has_value() && now < expiration_time.value()) {
+        return CacheState::kFresh;
+    }
+
+    if (expiration_time.has_value() && now - expiration_time.value() <= options_.max_stale) {
+        return CacheState::kStale;
+    }
+
+    if (!options_.retry_failed && cache_.LoadFailure(MakeFailureCacheKey(cache_filename)).has_value()) {
+        return CacheState::kFailed;
+    }
+
+    return CacheState::kMissing;
 }
 
 void WayHome::DumpRoutesToJson(const std::string& filename) const {
@@ -148,6 +436,22 @@ void WayHome::DumpRoutesPretty(std::ostream& stream) const {
         return;
     }
 
+    if (api_error_.has_value()) {
+        stream << "API is unavailable (" << api_error_->message << "), showing cached routes that expired "
+            << staleness_.value_or(std::chrono::seconds{0}).count() << " seconds ago\n\n";
+    } else if (staleness_.has_value()) {
+        stream << "Cached routes expired " << staleness_->count() << " seconds ago, "
+            << "they are being refreshed in the background\n\n";
+    }
+
+    for (const auto& [date, error] : failed_dates_) {
+        stream << "No routes on " << date << ": " << error.message << "\n";
+    }
+
+    if (!failed_dates_.empty()) {
+        stream << "\n";
+    }
+
     routes_.DumpRoutesPretty(stream, parameters_.max_transfers);
     if (routes_.HasError()) {
         error_ = routes_.GetError();
@@ -159,28 +463,31 @@ void WayHome::DumpRoutesToJson(std::ostream& stream) const {
         return;
     }
 
-    routes_.DumpRoutesToJson(stream, parameters_.max_transfers);
+    routes_.DumpRoutesToJson(stream, parameters_.max_transfers,
+        staleness_.has_value() ? std::optional<int64_t>{staleness_->count()} : std::nullopt);
     if (routes_.HasError()) {
         error_ = routes_.GetError();
     }
 }
 
 std::string WayHome::GetCacheFilename() const {
-    return std::format(
-        "{}_{}_{}_{}_{}transfers.json",
-        parameters_.from,
-        parameters_.to,
-        parameters_.date,
-        parameters_.transport_type,
-        std::to_string(parameters_.max_transfers)
-    );
+    // Routes with any number of transfers are cached, the limit is applied when they are dumped
+    return MakeRoutesCacheKey(parameters_);
 }
 
-void WayHome::UpdateRoutesWithAPI() {
-    std::expected<json, Error> request_result = api_->MakeRoutesRequest();
+void WayHome::UpdateRoutesWithAPI(bool reuse_cached_pages) {
+    std::expected<json, Error> request_result = RequestAllPages(*api_, reuse_cached_pages);
 
     if (!request_result.has_value()) {
-        error_ = api_->GetError();
+        error_ = request_result.error();
+
+        // Rejected parameters would be rejected again, network and API errors may go away
+        uint32_t failed_ttl_seconds = ttl_policy_.GetFailedTtlSeconds();
+
+        if (error_.type == ErrorType::kParametersError && failed_ttl_seconds != 0) {
+            cache_.RememberFailure(error_, MakeFailureCacheKey(GetCacheFilename()), failed_ttl_seconds);
+        }
+
         return;
     }
 
@@ -189,29 +496,204 @@ void WayHome::UpdateRoutesWithAPI() {
         error_ = routes_.GetError();
         return;
     }
-    
-    if (!cache_.UpdateCache(request_result.value(), GetCacheFilename())) {
+
+    staleness_.reset();
+    api_error_.reset();
+
+    if (!CacheRoutes(routes_, request_result.value(), GetCacheFilename())) {
         error_ = {"Unable to update cache", ErrorType::kEnvironmentError};
     }
 }
 
+std::expected<json, Error> WayHome::RequestAllPages(const ApiHandler& api, bool reuse_cached_pages) const {
+    // Each cached page is loaded once, and only a page that isn't cached takes from the request budget.
+    // std::nullopt means that the budget refused the page.
+    auto start_page = [&](size_t offset, std::launch policy) -> std::optional<std::future<std::expected<json, Error>>> {
+        std::optional<json> cached_page = reuse_cached_pages ? LoadCachedPage(offset) : std::nullopt;
+
+        if (cached_page.has_value()) {
+            std::promise<std::expected<json, Error>> ready_page;
+            ready_page.set_value(std::move(cached_page.value()));
+            return ready_page.get_future();
+        }
+
+        if (request_budget_ != nullptr && !request_budget_()) {
+            return std::nullopt;
+        }
+
+        return std::async(policy, [this, &api, offset] {
+            return RequestPage(api, offset);
+        });
+    };
+
+    // The first page is requested in this thread, the rest depends on its pagination
+    std::optional<std::future<std::expected<json, Error>>> first_future = start_page(0, std::launch::deferred);
+
+    if (!first_future.has_value()) {
+        return std::unexpected{Error{"API request budget is exhausted", ErrorType::kEnvironmentError}};
+    }
+
+    std::expected<json, Error> first_page = first_future->get();
+
+    if (!first_page.has_value() || !first_page->contains("pagination") || !first_page->contains("segments")) {
+        return first_page;
+    }
+
+    json& response_obj = first_page.value();
+    const json& pagination_obj = response_obj["pagination"];
+
+    size_t received = response_obj["segments"].size();
+    size_t total = pagination_obj.contains("total") && pagination_obj["total"].is_number_unsigned()
+        ? pagination_obj["total"].get<size_t>() : received;
+    size_t page_size = pagination_obj.contains("limit") && pagination_obj["limit"].is_number_unsigned()
+        ? pagination_obj["limit"].get<size_t>() : kApiPageLimit;
+
+    if (received == 0 || total <= received || page_size == 0) {
+        return first_page;
+    }
+
+    std::vector<std::future<std::expected<json, Error>>> pages;
+
+    for (size_t offset = received; offset < total && pages.size() + 1 < kMaxRoutePages; offset += page_size) {
+        // Without the budget for the rest, the search is truncated like the one past kMaxRoutePages
+        std::optional<std::future<std::expected<json, Error>>> page = start_page(offset, std::launch::async);
+
+        if (!page.has_value()) {
+            break;
+        }
+
+        pages.push_back(std::move(page.value()));
+    }
+
+    std::optional<Error> page_error;
+
+    // All pages are waited for, even after a failure: the threads use `api`
+    for (std::future<std::expected<json, Error>>& page : pages) {
+        std::expected<json, Error> page_result = page.get();
+
+        if (!page_result.has_value()) {
+            page_error = page_error.value_or(page_result.error());
+            continue;
+        }
+
+        if (!page_result->contains("segments") || !(*page_result)["segments"].is_array()) {
+            page_error = page_error.value_or(Error{"Invalid JSON: no \"segments\" in a page of routes", ErrorType::kDataError});
+            continue;
+        }
+
+        for (json& segment : (*page_result)["segments"]) {
+            response_obj["segments"].push_back(std::move(segment));
+        }
+    }
+
+    if (page_error.has_value()) {
+        return std::unexpected{page_error.value()};
+    }
+
+    // Reads as one page holding everything that was fetched, GetResponseKind still sees truncated searches
+    response_obj["pagination"]["offset"] = 0;
+    response_obj["pagination"]["limit"] = response_obj["segments"].size();
+
+    return first_page;
+}
+
+std::optional<json> WayHome::LoadCachedPage(size_t offset) const {
+    std::string page_filename = MakeRoutesPageCacheKey(parameters_, offset);
+    json page_obj;
+
+    if (cache_.IsCacheExpired(page_filename) || !cache_.LoadCache(page_obj, page_filename)) {
+        return std::nullopt;
+    }
+
+    return page_obj;
+}
+
+std::expected<json, Error> WayHome::RequestPage(const ApiHandler& api, size_t offset) const {
+    std::string page_filename = MakeRoutesPageCacheKey(parameters_, offset);
+    std::expected<json, Error> request_result = api.MakeRoutesPageRequest(offset);
+
+    if (!request_result.has_value()) {
+        return request_result;
+    }
+
+    // A page is complete by itself, the kind of the whole search is decided when it's merged
+    bool is_empty = !request_result->contains("segments") || (*request_result)["segments"].empty();
+    uint32_t ttl_seconds = ttl_policy_.GetTtlSeconds(
+        parameters_.date, parameters_.transport_type, is_empty ? ResponseKind::kFailed : ResponseKind::kComplete);
+
+    if (ttl_seconds != 0) {
+        cache_.UpdateCache(request_result.value(), page_filename, ttl_seconds);
+    }
+
+    return request_result;
+}
+
+bool WayHome::CacheRoutes(const RoutesHandler& routes, const json& response_obj, const std::string& filename) const {
+    uint32_t ttl_seconds = ttl_policy_.GetTtlSeconds(
+        parameters_.date, parameters_.transport_type, GetResponseKind(response_obj));
+
+    // A zero lifetime would mean that the entry never expires
+    if (ttl_seconds == 0) {
+        return true;
+    }
+
+    GetMemoryCache().Put(filename, routes, std::chrono::system_clock::now() + std::chrono::seconds(ttl_seconds));
+
+    return cache_.UpdateCacheBinary(routes.SerializeToBinary(), filename, ttl_seconds);
+}
+
+void WayHome::RefreshInBackground(const std::string& filename) {
+    if (api_ == nullptr) {
+        return;
+    }
+
+    // The thread has its own copy of the API handler, the routes being printed are not touched.
+    // A failed refresh leaves the stale entry until it's out of the staleness bound.
+    refresh_thread_ = std::jthread{[this, api = *api_, filename] {
+        std::expected<json, Error> request_result = RequestAllPages(api, false);
+
+        if (!request_result.has_value()) {
+            return;
+        }
+
+        RoutesHandler routes;
+        routes.BuildFromJson(request_result.value());
+
+        if (!routes.HasError()) {
+            CacheRoutes(routes, request_result.value(), filename);
+        }
+    }};
+}
+
 void WayHome::ClearAllCache() const {
+    GetMemoryCache().Clear();
+
     if (!cache_.ClearAllCache()) {
         error_ = {"Unable to clear all cache", ErrorType::kEnvironmentError};
     }
 }
 
 bool WayHome::LoadRoutesFromCache(const std::string& filename) {
-    json read_to;
-    bool is_reading_successful = cache_.LoadCache(read_to, filename);
+    std::optional<CacheView> view = cache_.ViewCache(filename);
+    bool is_reading_successful = view.has_value();
 
     if (is_reading_successful) {
-        routes_.BuildFromJson(read_to);
+        if (RoutesHandler::IsBinary(view->value)) {
+            routes_.BuildFromBinary(view->value);
+        } else if (!UpgradeJsonCache(view->value, filename)) {
+            return false;
+        }
 
         if (routes_.HasError()) {
             error_ = routes_.GetError();
             return false;
         }
+
+        std::optional<std::chrono::system_clock::time_point> expiration_time = cache_.GetExpirationTime(filename);
+
+        if (expiration_time.has_value()) {
+            GetMemoryCache().Put(filename, routes_, expiration_time.value());
+        }
     } else {
         error_ = {"Unable to load cache", ErrorType::kDataError};
     }
@@ -219,6 +701,71 @@ bool WayHome::LoadRoutesFromCache(const std::string& filename) {
     return is_reading_successful;
 }
 
+bool WayHome::LoadFailureFromCache(const std::string& filename) {
+    std::optional<Error> failure = cache_.LoadFailure(MakeFailureCacheKey(filename));
+
+    if (!failure.has_value()) {
+        return false;
+    }
+
+    error_ = failure.value();
+    error_.message += " (remembered, use --retry-failed to ask the API again)";
+
+    return true;
+}
+
+bool WayHome::UpgradeJsonCache(std::string_view data, const std::string& filename) {
+    json read_to = json::parse(data.begin(), data.end(), nullptr, false);
+
+    if (read_to.is_discarded()) {
+        error_ = {"Unable to load cache", ErrorType::kDataError};
+        return false;
+    }
+
+    routes_.BuildFromJson(read_to);
+
+    // Entries written before the binary format are rewritten once, keeping their lifetime
+    if (!routes_.HasError()) {
+        cache_.RewriteCacheBinary(routes_.SerializeToBinary(), filename);
+    }
+
+    return true;
+}
+
+std::optional<std::chrono::seconds> WayHome::GetStaleness() const {
+    return staleness_;
+}
+
+MemoryCache& WayHome::GetMemoryCache() {
+    static MemoryCache memory_cache{kMemoryCacheMaxEntries, kMemoryCacheMaxBytes};
+    return memory_cache;
+}
+
+void WayHome::DumpCacheStats(std::ostream& stream) const {
+    CacheStats stats = cache_.GetStats();
+
+    json stats_obj{
+        {"entries", stats.entries},
+        {"max_entries", stats.max_entries},
+        {"compressed_entries", stats.compressed_entries},
+        {"stored_bytes", stats.stored_bytes},
+        {"raw_bytes", stats.raw_bytes},
+        {"disk_bytes", stats.disk_bytes},
+        {"max_bytes", stats.max_bytes},
+        {"segments", stats.segments},
+        {"evictions", stats.evictions},
+        {"eviction", stats.eviction_policy == EvictionPolicy::kLfu ? "lfu" : "lru"},
+        {"memory_entries", GetMemoryCache().GetSize()},
+        {"memory_bytes", GetMemoryCache().GetBytes()}
+    };
+
+    stream << std::setw(4) << stats_obj << std::endl;
+}
+
+void WayHome::SetRequestBudget(std::function<bool()> request_budget) {
+    request_budget_ = std::move(request_budget);
+}
+
 const std::vector<Route>& WayHome::GetRoutes() const {
     return routes_.GetRoutes();
 }
@@ -3,11 +3,25 @@
 #include "ApiHandler.hpp"
 #include "RoutesHandler.hpp"
 #include "CacheHandler.hpp"
+#include "CacheKey.hpp"
 #include "CodeSearcher.hpp"
+#include "MemoryCache.hpp"
+#include "TtlPolicy.hpp"
+#include "SessionPool.hpp"
+#include "Quota.hpp"
+#include "Retry.hpp"
 
 #include <string>
 #include <memory>
 #include <ostream>
+#include <chrono>
+#include <string_view>
+#include <optional>
+#include <expected>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <functional>
 
 namespace WayHome {
 
@@ -16,12 +30,45 @@ const std::string kSettingsFilename{"wayhome_settings.json"};
 const std::string kCacheDir{"wayhome_cache"};
 const uint32_t kCacheSecondsTTL = 7 * 24 * 60 * 60;
 
+const size_t kMaxDatesPerSearch = 31;
+// Dates searched at the same time, the rest wait for one of them to finish
+const size_t kDateSearchJobs = 4;
+// Pages of kApiPageLimit routes fetched for one search, each costs a request of the daily quota.
+// Routes past them are left out and the search is cached as partial.
+const size_t kMaxRoutePages = 20;
+
+const size_t kMemoryCacheMaxEntries = 256;
+const size_t kMemoryCacheMaxBytes = 64 * 1024 * 1024;
+
+struct CacheOptions {
+    // Repeat lookups and searches that failed recently instead of reporting the remembered failure
+    bool retry_failed = false;
+    // Routes that expired less than this long ago are printed right away and refreshed
+    // in the background, 0 to always wait for the API
+    std::chrono::seconds max_stale{0};
+    // Routes that expired less than this long ago are printed when the API fails, 0 to report the failure
+    std::chrono::seconds stale_if_error{24 * 60 * 60};
+};
+
+enum class CacheState {
+    kMissing,
+    kFresh,
+    // Expired, but within CacheOptions::max_stale
+    kStale,
+    // A remembered failure, see CacheOptions::retry_failed
+    kFailed
+};
+
 class WayHome {
 public:
-    WayHome(const std::string& apikey, const ApiRouteParameters& parameters);
-    WayHome(const ApiRouteParameters& parameters);
+    WayHome(const std::string& apikey, const ApiRouteParameters& parameters, const CacheOptions& options = {});
+    WayHome(const ApiRouteParameters& parameters, const CacheOptions& options = {});
 
     void CalculateRoutes();
+    // Searches on up to kDateSearchJobs of the dates at the same time, cached dates are not asked again
+    // unless `update_cache` is set. The routes are merged and ordered by departure. Dates that failed
+    // are reported by DumpRoutesPretty, the search fails only if all of them did.
+    void CalculateRoutes(const std::vector<std::string>& dates, bool update_cache = false);
 
     void DumpRoutesToJson(std::ostream& stream) const;
     void DumpRoutesToJson(const std::string& filename) const;
@@ -36,30 +83,80 @@ public:
     const Error& GetError() const;
     bool HasError() const;
 
-    void UpdateRoutesWithAPI();
+    // Pages cached by an earlier search that failed halfway are asked again only without `reuse_cached_pages`
+    void UpdateRoutesWithAPI(bool reuse_cached_pages = false);
+
+    // Asked before each search request the next searches would send, a refused request is not sent.
+    // The search fails if its first page is refused and is cached as partial if a later one is.
+    void SetRequestBudget(std::function<bool()> request_budget);
+
+    // What CalculateRoutes would find in the cache
+    CacheState GetCacheState() const;
 
     void ClearAllCache() const;
 
+    void DumpCacheStats(std::ostream& stream) const;
+
+    // How long ago the routes expired if they were answered from a stale cache entry
+    std::optional<std::chrono::seconds> GetStaleness() const;
+
 private:
     RoutesHandler routes_;
     std::unique_ptr<ApiHandler> api_;
     CacheHandler cache_{kCacheDir, kCacheSecondsTTL};
+    TtlPolicy ttl_policy_;
 
     CodeSearcher code_searcher_;
     ApiRouteParameters parameters_;
+    CacheOptions options_;
 
     std::string apikey_;
 
+    std::function<bool()> request_budget_;
+
     mutable Error error_;
 
+    std::optional<std::chrono::seconds> staleness_;
+    // The failure of the API the stale routes are printed instead of
+    std::optional<Error> api_error_;
+
+    // Searches made by CalculateRoutes(dates), kept until their background refreshes are done
+    std::vector<std::unique_ptr<WayHome>> date_searches_;
+    std::vector<std::pair<std::string, Error>> failed_dates_;
+
+    // Declared last to be joined before the members it uses are destroyed
+    std::jthread refresh_thread_;
+
+    // Search of the same resolved endpoints on another date, the settings are not read again
+    WayHome(const WayHome& parent, const std::string& date);
+
     std::string GetCacheFilename() const;
 
+    // Fetches the first page, then the rest of them at the same time, and merges their segments
+    // into one response. Each page is cached on its own, so a failed page doesn't cost the others again.
+    std::expected<json, Error> RequestAllPages(const ApiHandler& api, bool reuse_cached_pages) const;
+    std::optional<json> LoadCachedPage(size_t offset) const;
+    std::expected<json, Error> RequestPage(const ApiHandler& api, size_t offset) const;
+
+    // Stores routes received from the API in both cache tiers
+    bool CacheRoutes(const RoutesHandler& routes, const json& response_obj, const std::string& filename) const;
+    void RefreshInBackground(const std::string& filename);
+
     bool LoadRoutesFromCache(const std::string& filename);
+    bool LoadFailureFromCache(const std::string& filename);
+    // Answers with expired routes within CacheOptions::stale_if_error after the API failed
+    bool FallBackToStaleCache(const std::string& filename,
+                              const std::optional<std::chrono::system_clock::time_point>& expiration_time);
+    bool UpgradeJsonCache(std::string_view data, const std::string& filename);
+
+    // Shared by all WayHome instances of the process
+    static MemoryCache& GetMemoryCache();
 
     void ReadSettings();
     void CreateSettingsFile() const;
 
     bool SetCodeForEndpoints();
+    bool SetEndpointCode(std::string& point, const std::expected<std::string, Error>& search_result);
 };
     
 } // namespace WayHome
@@ -1,11 +1,27 @@
 #include "WayHome.hpp"
+#include "CacheWarmer.hpp"
+#include "Metrics.hpp"
+#include "StationDirectory.hpp"
+#include "Date.hpp"
+#include "Quota.hpp"
 
 #include <argparser/ArgParser.hpp>
 
 #include <iostream>
+#include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <optional>
+#include <sstream>
+#include <algorithm>
 
 void SetParserAgruments(ArgumentParser::ArgParser& argparser, WayHome::ApiRouteParameters& params);
-bool HandleParserErrors(const ArgumentParser::ArgParser& argparser);
+bool HandleParserErrors(const ArgumentParser::ArgParser& argparser, bool is_route_optional);
+void DumpMetrics(const ArgumentParser::ArgParser& argparser);
+std::optional<std::vector<std::string>> GetSearchDates(const ArgumentParser::ArgParser& argparser);
 
 int main(int argc, char** argv) {
     WayHome::ApiRouteParameters params;
@@ -21,11 +37,100 @@ int main(int argc, char** argv) {
         return EXIT_SUCCESS;
     }
     
-    if (!HandleParserErrors(argparser)) {
+    bool is_warming = *argparser.GetValuesSet("warm") != 0;
+    bool is_importing = *argparser.GetValuesSet("import-stations") != 0;
+    bool is_suggesting = *argparser.GetValuesSet("suggest") != 0;
+    bool is_multi_date = *argparser.GetValuesSet("dates") != 0 || *argparser.GetValuesSet("date-from") != 0;
+
+    if (!HandleParserErrors(argparser, is_warming || is_importing || is_suggesting || is_multi_date)) {
         return EXIT_FAILURE;
     }
 
-    WayHome::WayHome wayhome{params};
+    std::optional<std::vector<std::string>> dates;
+
+    if (is_multi_date) {
+        dates = GetSearchDates(argparser);
+
+        if (!dates.has_value()) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (is_importing) {
+        std::expected<size_t, WayHome::Error> imported = WayHome::StationDirectory::Import(
+            *argparser.GetValue<std::string>("import-stations"), WayHome::kStationDirectoryFilename);
+
+        if (!imported.has_value()) {
+            std::cerr << imported.error().message << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::cout << "Imported " << imported.value() << " stations and settlements to "
+            << WayHome::kStationDirectoryFilename << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    if (is_suggesting) {
+        WayHome::CodeSearcher code_searcher;
+
+        for (const WayHome::StationCandidate& candidate : code_searcher.Suggest(*argparser.GetValue<std::string>("suggest"))) {
+            std::cout << candidate.point.code << '\t' << candidate.point.title;
+
+            if (!candidate.point.station_type.empty()) {
+                std::cout << " (" << candidate.point.station_type << ')';
+            }
+
+            std::cout << '\n';
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    WayHome::CacheOptions cache_options;
+    cache_options.retry_failed = *argparser.GetValue<bool>("retry-failed");
+    cache_options.max_stale = std::chrono::seconds{*argparser.GetValue<uint32_t>("max-stale")};
+    cache_options.stale_if_error = std::chrono::seconds{*argparser.GetValue<uint32_t>("stale-if-error")};
+
+    if (is_warming) {
+        WayHome::CacheWarmer warmer{
+            cache_options, *argparser.GetValue<uint32_t>("warm-jobs"), *argparser.GetValue<uint32_t>("warm-max-requests")};
+
+        if (!warmer.LoadSpecs(*argparser.GetValue<std::string>("warm"))) {
+            std::cerr << warmer.GetError().message << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        {
+            // The warm-up may take long, the metrics file is kept current while it runs
+            std::jthread metrics_writer;
+
+            if (*argparser.GetValuesSet("metrics-file") != 0) {
+                metrics_writer = std::jthread{[path = *argparser.GetValue<std::string>("metrics-file")](std::stop_token stop_token) {
+                    std::mutex mutex;
+                    std::condition_variable_any wakeup;
+                    std::unique_lock lock{mutex};
+
+                    while (!stop_token.stop_requested()) {
+                        wakeup.wait_for(lock, stop_token, WayHome::kMetricsWriteInterval, [] { return false; });
+
+                        if (stop_token.stop_requested()) {
+                            break;
+                        }
+
+                        WayHome::GetMetrics().WritePrometheus(path);
+                    }
+                }};
+            }
+
+            warmer.Run(std::cout);
+        }
+
+        // Writes the final metrics file after the writer has stopped
+        DumpMetrics(argparser);
+        return EXIT_SUCCESS;
+    }
+
+    WayHome::WayHome wayhome{params, cache_options};
 
     if (*argparser.GetValue<bool>("clear-cache")) {
         wayhome.ClearAllCache();
@@ -34,7 +139,9 @@ int main(int argc, char** argv) {
         }
     }
 
-    if (*argparser.GetValue<bool>("update-cache")) {
+    if (dates.has_value()) {
+        wayhome.CalculateRoutes(dates.value(), *argparser.GetValue<bool>("update-cache"));
+    } else if (*argparser.GetValue<bool>("update-cache")) {
         wayhome.UpdateRoutesWithAPI();
     } else {
         wayhome.CalculateRoutes();
@@ -47,6 +154,12 @@ int main(int argc, char** argv) {
 
     wayhome.DumpRoutesPretty(std::cout);
 
+    if (*argparser.GetValue<bool>("cache-stats")) {
+        wayhome.DumpCacheStats(std::cout);
+    }
+
+    DumpMetrics(argparser);
+
     if (wayhome.HasError()) {
         std::cerr << wayhome.GetError().message << std::endl;
         return EXIT_FAILURE;
@@ -65,6 +178,15 @@ void SetParserAgruments(ArgumentParser::ArgParser& argparser, WayHome::ApiRouteP
     argparser.AddArgument<std::string>("date", "Date of departure in \"YYYY-MM-DD\" format")
         .StoreValue(params.date);
 
+    argparser.AddArgument<std::string>("date-from", "First date of departure of a search on several days")
+        .Default("none");
+
+    argparser.AddArgument<std::string>("date-to", "Last date of departure of a search on several days")
+        .Default("none");
+
+    argparser.AddArgument<std::string>("dates", "Comma separated dates of departure of a search on several days")
+        .Default("none");
+
     argparser.AddArgument<uint32_t>("transfers", "Maximum number of transfers")
         .Default(1)
         .StoreValue(params.max_transfers);
@@ -77,19 +199,125 @@ void SetParserAgruments(ArgumentParser::ArgParser& argparser, WayHome::ApiRouteP
     argparser.AddArgument<std::string>("file", "Name of the JSON file where the routes will be stored rather than printed")
         .Default("none");
 
+    argparser.AddArgument<uint32_t>("max-stale", "Answer with routes expired at most this many seconds ago "
+        "and refresh them in the background")
+        .Default(0);
+
+    argparser.AddArgument<uint32_t>("stale-if-error", "Answer with routes expired at most this many seconds ago "
+        "if the API fails")
+        .Default(24 * 60 * 60);
+
+    argparser.AddArgument<std::string>("warm", "JSON file with queries to fill the cache with instead of searching, "
+        "see README")
+        .Default("none");
+
+    argparser.AddArgument<uint32_t>("warm-jobs", "Number of queries made at the same time by the warm-up")
+        .Default(WayHome::kWarmDefaultJobs);
+
+    argparser.AddArgument<uint32_t>("warm-max-requests", "Maximum number of API searches made by the warm-up")
+        .Default(WayHome::kWarmDefaultMaxRequests);
+
+    argparser.AddArgument<std::string>("import-stations", "Build the offline station directory "
+        "from a stations_list JSON file and exit")
+        .Default("none");
+
+    argparser.AddArgument<std::string>("suggest", "Print the stations and settlements of the offline directory "
+        "with titles resembling the given one and exit")
+        .Default("none");
+
     argparser.AddFlag("update-cache", "Force to make a new call to API even if suitable routes are cached");
     argparser.AddFlag("clear-cache", "Clear all cache before calculation");
+    argparser.AddFlag("cache-stats", "Print cache statistics after calculation");
+    argparser.AddFlag("retry-failed", "Ask the API again about names and searches that failed recently");
+    argparser.AddFlag("stats", "Print cache and API counters and latencies as JSON after calculation");
+    argparser.AddFlag("quota", "Print the API requests made and left today as JSON after calculation");
+
+    argparser.AddArgument<std::string>("metrics-file", "File where the metrics are written in Prometheus text format")
+        .Default("none");
         
     argparser.AddHelp("help", "Show help and exit");
 }
 
-bool HandleParserErrors(const ArgumentParser::ArgParser& argparser) {
+void DumpMetrics(const ArgumentParser::ArgParser& argparser) {
+    if (*argparser.GetValue<bool>("stats")) {
+        std::cout << std::setw(4) << WayHome::GetMetrics().ToJson() << std::endl;
+    }
+
+    if (*argparser.GetValue<bool>("quota")) {
+        std::cout << std::setw(4) << WayHome::GetApiQuota().ToJson() << std::endl;
+    }
+
+    if (*argparser.GetValuesSet("metrics-file") != 0
+    && !WayHome::GetMetrics().WritePrometheus(*argparser.GetValue<std::string>("metrics-file"))) {
+        std::cerr << "Unable to write the metrics to " << *argparser.GetValue<std::string>("metrics-file") << std::endl;
+    }
+}
+
+std::optional<std::vector<std::string>> GetSearchDates(const ArgumentParser::ArgParser& argparser) {
+    std::vector<std::string> dates;
+
+    if (*argparser.GetValuesSet("dates") != 0) {
+        std::istringstream list{*argparser.GetValue<std::string>("dates")};
+
+        for (std::string date; std::getline(list, date, ',');) {
+            if (!WayHome::ParseDate(date).has_value()) {
+                std::cerr << "Invalid date, must be YYYY-MM-DD: " << date << std::endl;
+                return std::nullopt;
+            }
+
+            dates.push_back(date);
+        }
+    }
+
+    if (*argparser.GetValuesSet("date-from") != 0) {
+        std::string date_from = *argparser.GetValue<std::string>("date-from");
+        std::string date_to = *argparser.GetValuesSet("date-to") != 0 ? *argparser.GetValue<std::string>("date-to") : date_from;
+
+        std::optional<std::chrono::sys_days> first_day = WayHome::ParseDate(date_from);
+        std::optional<std::chrono::sys_days> last_day = WayHome::ParseDate(date_to);
+
+        if (!first_day.has_value() || !last_day.has_value()) {
+            std::cerr << "Invalid date range, dates must be YYYY-MM-DD: " << date_from << " - " << date_to << std::endl;
+            return std::nullopt;
+        }
+
+        std::optional<std::vector<std::string>> range
+            = WayHome::ExpandDateRange(first_day.value(), last_day.value(), WayHome::kMaxDatesPerSearch);
+
+        if (!range.has_value()) {
+            std::cerr << "The date range must be ordered and at most " << WayHome::kMaxDatesPerSearch
+                << " days long" << std::endl;
+            return std::nullopt;
+        }
+
+        dates.insert(dates.end(), range->begin(), range->end());
+    }
+
+    // YYYY-MM-DD dates are ordered as strings
+    std::ranges::sort(dates);
+    dates.erase(std::ranges::unique(dates).begin(), dates.end());
+
+    if (dates.empty() || dates.size() > WayHome::kMaxDatesPerSearch) {
+        std::cerr << "From 1 to " << WayHome::kMaxDatesPerSearch << " dates must be given" << std::endl;
+        return std::nullopt;
+    }
+
+    return dates;
+}
+
+bool HandleParserErrors(const ArgumentParser::ArgParser& argparser, bool is_route_optional) {
     if (!argparser.HasError()) {
         return true;
     }
 
     ArgumentParser::ParsingError error = argparser.GetError();
 
+    // The warm-up takes route arguments from its specs file, the import and suggestions don't need them,
+    // a search on several days has no single date
+    if (is_route_optional && error.status == ArgumentParser::ParsingErrorType::kNoArgument) {
+        return true;
+    }
+
     if (error.status == ArgumentParser::ParsingErrorType::kUnknownArgument) {
         std::cerr << "Unknown argument: " << error.argument_string << std::endl;
         return false;